@@ -0,0 +1,130 @@
+/**
+ * Vaccination Management System - Arena Allocator
+ * @brief: This file contains the bump allocator backing the system:
+ * - Blocks of doubling size, so a few of them hold any amount of data
+ * - Allocation and in-place growth of the last allocation
+ * - Release of everything at once
+ * @file: arena.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "project.h"
+
+/** Rounds a size up to the arena alignment
+ * @param size   size in bytes
+ * @return  aligned size
+ */
+static size_t align_size(size_t size) {
+    return (size + ARENAALIGN - 1) & ~(size_t)(ARENAALIGN - 1);
+}
+
+
+/** Start of the usable memory of a block
+ * @param block   arena block
+ * @return  first byte after the block header
+ */
+static char *block_data(ArenaBlock *block) {
+    return (char *)block + align_size(sizeof(ArenaBlock));
+}
+
+
+/** Initializes an empty arena
+ * @param arena   arena structure
+ * @param idiom   language identifier, for the out-of-memory message
+ */
+void set_arena(Arena *arena, int idiom) {
+    arena->block = NULL;
+    arena->last = NULL;
+    arena->bytes = 0;
+    arena->resizes = 0;
+    arena->idiom = idiom;
+}
+
+
+/** Allocates memory from an arena
+ * @param arena   arena structure
+ * @param size   size in bytes
+ * @details Opens a new block, twice as big as the current one (or as
+big as the request), when the current one is full. Never returns NULL:
+exhausting memory goes through check_allocation()
+ * @return  pointer to the memory, aligned to ARENAALIGN
+ */
+void *arena_alloc(Arena *arena, size_t size) {
+    ArenaBlock *block = arena->block;
+    void *ptr;
+
+    size = align_size(size);
+    if (block == NULL || block->used + size > block->size) {
+        size_t block_size = block ? block->size * 2 : ARENABLOCK;
+        if (block_size > ARENAMAXBLOCK) {
+            block_size = ARENAMAXBLOCK;
+        }
+        if (block_size < size) {
+            block_size = size;
+        }
+        block = malloc(align_size(sizeof(ArenaBlock)) + block_size);
+        check_allocation(block, arena->idiom);
+        block->prev = arena->block;
+        block->size = block_size;
+        block->used = 0;
+        arena->block = block;
+    }
+    ptr = block_data(block) + block->used;
+    block->used += size;
+    arena->bytes += size;
+    arena->last = ptr;
+    return ptr;
+}
+
+
+/** Grows an arena allocation, like realloc()
+ * @param arena   arena structure
+ * @param ptr   current allocation (NULL for a new one)
+ * @param old_size   current size in bytes
+ * @param new_size   new size in bytes
+ * @details The last allocation of the block grows in place when it fits;
+otherwise the data is copied and the old space is only reclaimed by
+free_arena(), which costs at most as much as the final size for arrays
+grown geometrically. Pointers into the old copy stay readable until then,
+which name_of() promises its callers
+ * @return  pointer to the grown allocation
+ */
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size) {
+    ArenaBlock *block = arena->block;
+    void *new_ptr;
+
+    if (ptr != NULL) {
+        arena->resizes++;
+    }
+    if (ptr != NULL && ptr == arena->last) {
+        size_t extra = align_size(new_size) - align_size(old_size);
+        if (block->used + extra <= block->size) { /* grow in place */
+            block->used += extra;
+            arena->bytes += extra;
+            return ptr;
+        }
+    }
+    new_ptr = arena_alloc(arena, new_size);
+    if (ptr != NULL) {
+        memcpy(new_ptr, ptr, old_size);
+    }
+    return new_ptr;
+}
+
+
+/** Releases every block of an arena at once
+ * @param arena   arena structure
+ */
+void free_arena(Arena *arena) {
+    while (arena->block != NULL) {
+        ArenaBlock *prev = arena->block->prev;
+        free(arena->block);
+        arena->block = prev;
+    }
+    arena->last = NULL;
+    arena->bytes = 0;
+    arena->resizes = 0;
+}
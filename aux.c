@@ -12,22 +12,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/mman.h>
 
 #include "project.h"
 
 /** Checks for duplicate batch names in existing batches
- * @param num   number of batches
- * @param batches   array of Batch structures
+ * @param sys   system structure
  * @param batch_name   name of the batch
  * @return   1 if duplicate exists, 0 if name is unique
  */
-int validate_dup_batch_name(int num, Batch *batches, char *batch_name) {
-    for (int i = 0; i < num; i++) {
-        if (strcmp(batches[i].batch_name, batch_name) == 0) {
-            return 1;
-        }
-    }
-    return 0;
+int validate_dup_batch_name(Sys *sys, const char *batch_name) {
+    return find_batch(sys, batch_name) != NIL;
 }
 
 
@@ -35,7 +30,7 @@ int validate_dup_batch_name(int num, Batch *batches, char *batch_name) {
  * @param batch_name   name of the batch
  * @return  1 if exceeds limit, 0 if within bounds
  */
-int validate_batch_name_max(char *batch_name) {
+int validate_batch_name_max(const char *batch_name) {
     if (strlen(batch_name) > MAXBATCHNAME) {
         return 1;
     }
@@ -48,7 +43,7 @@ characters (0-9, A-F)
  * @param batch_name   name of the batch
  * @return  1 if invalid characters found, 0 if valid
  */
-int validate_batch_name_caract(char *batch_name) {
+int validate_batch_name_caract(const char *batch_name) {
     for (int i = 0; *(batch_name +i) != '\0'; i++) {
         if (!((*(batch_name +i) >= '0' && *(batch_name +i) <= '9') ||
         (*(batch_name +i) >= 'A' && *(batch_name +i) <= 'F'))) {
@@ -63,7 +58,10 @@ int validate_batch_name_caract(char *batch_name) {
  * @param vacc_name   name of the vaccine
  * @return  1 if invalid, 0 if valid
  */
-int validate_vacc_name(char *vacc_name) {
+int validate_vacc_name(const char *vacc_name) {
+    if (*vacc_name == '\0') { /* missing from the command */
+        return 1;
+    }
     for (int i = 0; *(vacc_name +i) != '\0'; i++) {
         if (*(vacc_name +i) == ' ' || *(vacc_name +i) == '\n' ||
         *(vacc_name +i) == '\t') {
@@ -92,19 +90,25 @@ int validate_doses(int doses) {
  * @param date   date to validate
  * @return  1 if invalid, 0 if valid
  */
-int validate_date(Date *date, Sys *sys) {
-    Date current_date = sys->today;
+int validate_date(const Date *date, Sys *sys) {
+    return *date < sys->today || validate_calendar(date);
+}
+
 
-    if (date->year < current_date.year ||
-    (date->year == current_date.year && date->month < current_date.month) ||
-    (date->year == current_date.year && date->month == current_date.month &&
-    date->day < current_date.day)) {
+/** Validates date against calendar rules only
+ * @param date   date to validate
+ * @details Dates with a field saturated by parse_date() are never valid
+ * @return  1 if invalid, 0 if valid
+ */
+int validate_calendar(const Date *date) {
+    int day = DATEDAY(*date), month = DATEMONTH(*date);
+
+    if (DATEYEAR(*date) == DATEMAXYEAR) {
         return 1;
     }
     /* definition of days per month (index 0 will not be used) */
     int days_in_month[] = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-    if (date->month < 1 || date->month > 12 || date->day < 1 ||
-    date->day > days_in_month[date->month]) {
+    if (month < 1 || month > 12 || day < 1 || day > days_in_month[month]) {
         return 1;
     }
     return 0;
@@ -118,10 +122,17 @@ int validate_date(Date *date, Sys *sys) {
  */
 void set_batch_slots(Batch *batches, int start, int end) {
     for (int i = start; i < end; i++) {
-        (*(batches + i)).batch_name = NULL;
-        (*(batches + i)).vacc_name = NULL;
+        (*(batches + i)).batch_id = NIL;
+        (*(batches + i)).vacc_id = NIL;
         (*(batches + i)).num_app = 0;
         (*(batches + i)).doses = 0;
+        (*(batches + i)).left = NIL;
+        (*(batches + i)).right = NIL;
+        (*(batches + i)).height = 0;
+        (*(batches + i)).vacc = NIL;
+        (*(batches + i)).heap_pos = NIL;
+        (*(batches + i)).rec_head = NIL;
+        (*(batches + i)).rec_tail = NIL;
     }
 }
 
@@ -132,39 +143,32 @@ void set_batch_slots(Batch *batches, int start, int end) {
  * @param vacc_name   name of the vaccine
  * @param exp_date   expiration date
  * @param doses   number of doses
- * @param idiom   language identifier
  * @details Checks capacity, date, duplicates, naming rules, and doses
- * @return 1 if any validation fails, 0 if all valid
+ * @return  ERRNONE if all valid, the code of the first failure otherwise
  */
-int validate_batch_inputs(Sys *sys, char *batch_name, char *vacc_name,
-    Date *exp_date, int doses, int idiom) {
+int validate_batch_inputs(Sys *sys, const char *batch_name,
+    const char *vacc_name, const Date *exp_date, int doses) {
 
     if (sys->num_batch >= MAXBATCH) {
-        puts(idiom == 0 ? E2MANYVACC : E2MANYVACCPT);
-        return 1;
+        return ERR2MANYVACC;
     }
     if (validate_date(exp_date, sys)) {
-        puts(idiom == 0 ? EINVDATE : EINVDATEPT);
-        return 1;
+        return ERRINVDATE;
     }
-    if (validate_dup_batch_name(sys->num_batch, sys->batches, batch_name)) {
-        puts(idiom == 0 ? EDUPBATCH : EDUPBATCHPT);
-        return 1;
+    if (validate_dup_batch_name(sys, batch_name)) {
+        return ERRDUPBATCH;
     }
     if (validate_vacc_name(vacc_name)) {
-        puts(idiom == 0 ? EINVNAME : EINVNAMEPT);
-        return 1;
+        return ERRINVNAME;
     }
     if (validate_batch_name_max(batch_name) ||
     validate_batch_name_caract(batch_name)) {
-        puts(idiom == 0 ? EINVBATCH : EINVBATCHPT);
-        return 1;
+        return ERRINVBATCH;
     }
     if (validate_doses(doses)) {
-        puts(idiom == 0 ? EINVQUANT : EINVQUANTPT);
-        return 1;
+        return ERRINVQUANT;
     }
-    return 0;
+    return ERRNONE;
 }
 
 
@@ -174,98 +178,84 @@ int validate_batch_inputs(Sys *sys, char *batch_name, char *vacc_name,
  * @return  negative if date1 is earlier, positive if date1 is later,
 0 if dates are equal
  */
-int ord_date(Date *date1, Date *date2) {
-    if (date1->year != date2->year) {
-        return date1->year - date2->year;
-    }
-    if (date1->month != date2->month) {
-        return date1->month - date2->month;
-    }
-    return date1->day - date2->day;
+int ord_date(const Date *date1, const Date *date2) {
+    return (*date1 > *date2) - (*date1 < *date2);
 }
 
 
 /** Compares two batches for sorting purposes
+ * @param sys   system structure
  * @param a   first batch
  * @param b   second batch
  * @details Primary sort by expiration date, secondary by batch name
  * @return  negative if a comes first, positive if b comes first,
 0 if equal
  */
-int ord_batches(Batch *a, Batch *b) {
-    int cmp = ord_date(&a->exp_date, &b->exp_date);
-    if (cmp != 0) { /* if dates different */
-        return cmp;
+int ord_batches(Sys *sys, Batch *a, Batch *b) {
+    if (a->exp_date != b->exp_date) { /* if dates different */
+        return a->exp_date < b->exp_date ? -1 : 1;
     }
-    return strcmp(a->batch_name, b->batch_name);
-}
-
-
-/** Sorts batches array
- * @param batches   array of Batch structures
- * @param num_batches   number of batches
- * @details Orders by expiration date (chronologically),
-then by batch name (alphabetical)
- */
-void sort_batches(Batch *batches, int num_batches) {
-    /* outer loop: control the number of passes through the array */
-    for (int i = 0; i < num_batches - 1; i++) {
-        /* inner loop: handles the comparisons and swaps */
-        for (int j = 0; j < num_batches - i - 1; j++) {
-            /* compare adjacent batches */
-            if (ord_batches(&batches[j], &batches[j + 1]) > 0) {
-                /* perform the swap using a temporary variable */
-                Batch temp = batches[j];
-                batches[j] = batches[j + 1];
-                batches[j + 1] = temp;
-            }
-        }
+    if (a->batch_id == b->batch_id) { /* same batch */
+        return 0;
     }
+    return strcmp(name_of(&sys->names, a->batch_id),
+        name_of(&sys->names, b->batch_id));
 }
 
 
 /** Prints batch information in required format
- * @param batch   batch structure
+ * @param batch   batch as listed by list_batches()
  * @details Format: <vaccine_name> <batch_name> <dd-mm-yy> <doses>
  <applications>
  */
-void print_batch_info(const Batch *batch) {
-    printf("%s %s %02d-%02d-%02d %d %d\n",
-           batch->vacc_name,
-           batch->batch_name,
-           batch->exp_date.day,
-           batch->exp_date.month,
-           batch->exp_date.year,
-           batch->doses,
-           batch->num_app);
+void print_batch_info(const BatchInfo *batch) {
+    write_str(batch->vacc_name);
+    write_char(' ');
+    write_str(batch->batch_name);
+    write_char(' ');
+    write_date(&batch->exp_date);
+    write_char(' ');
+    write_int(batch->doses);
+    write_char(' ');
+    write_int(batch->num_app);
+    write_char('\n');
 }
 
 
-/** Extracts username from input command, handling both quoted and
-unquoted names
- * @param input   input line
- * @param user_name   buffer to store extracted username
+/** Computes the next capacity of a growing array
+ * @param capacity   current capacity
+ * @param growth   growth factor, in percent
+ * @return  new capacity, always larger than the current one
  */
-void extract_user(char *input, char *user_name) {
-    int i = 2, j = 0; /* start after command letter */
+int grow_capacity(int capacity, int growth) {
+    long next = (long)capacity * growth / 100;
 
-    /* case quoted (with spaces) */
-    if (input[i] == '"') {
-        while (input[++i] != '"') { /* skip first quote */
-            user_name[j++] = input[i];
-        }
-        i++; /* skip final quote */
-    /* handle unquoted username */
-    } else {
-        while (input[i] != ' ' && input[i] != '\0') {
-            user_name[j++] = input[i++];
-        }
+    if (capacity == 0) {
+        return 10;
     }
+    return next > capacity ? (int)next : capacity + 1;
+}
 
-    /* end username and clean nline if present */
-    user_name[j] = '\0';
-    if (j > 0 && user_name[j - 1] == '\n') {
-        user_name[j - 1] = '\0';
+
+/** Makes room for records after the last one
+ * @param sys   system structure
+ * @param count   records about to be added
+ * @details Adds whole chunks, so existing records are never copied; only
+the small chunk directory is grown by inocula_growth
+ */
+void reserve_inocula(Sys *sys, int count) {
+    while ((long long)sys->num_inocula + count >
+        (long long)sys->num_chunks * CHUNKSIZE) {
+        if (sys->num_chunks >= sys->chunk_capacity) {
+            int old_capacity = sys->chunk_capacity;
+            sys->chunk_capacity = grow_capacity(sys->chunk_capacity,
+                sys->inocula_growth);
+            sys->chunks = arena_grow(&sys->record_arena, sys->chunks,
+                sizeof(InoculaChunk *) * old_capacity,
+                sizeof(InoculaChunk *) * sys->chunk_capacity);
+        }
+        sys->chunks[sys->num_chunks++] = arena_alloc(&sys->record_arena,
+            sizeof(InoculaChunk));
     }
 }
 
@@ -274,110 +264,183 @@ void extract_user(char *input, char *user_name) {
  * @param sys   system structure
  */
 void expand_inocula_memory(Sys *sys) {
-    if (sys->num_inocula >= sys->mem_capacity) {
-        sys->mem_capacity = (sys->mem_capacity > 0) ?
-        sys->mem_capacity * 2 : 10;
+    reserve_inocula(sys, 1);
+}
 
-        sys->inocula = (Inocula *)realloc(sys->inocula,
-            sizeof(Inocula) * sys->mem_capacity);
-    }
+
+/** Reads the inoculation at an index
+ * @param sys   system structure
+ * @param pos   index of the record
+ * @param inocula   receives every field of the record
+ */
+void load_inocula(Sys *sys, int pos, Inocula *inocula) {
+    inocula->user_id = INOCULA(sys, pos, user_id);
+    inocula->vacc_id = INOCULA(sys, pos, vacc_id);
+    inocula->batch_id = INOCULA(sys, pos, batch_id);
+    inocula->ap_date = INOCULA(sys, pos, ap_date);
+    inocula->next = INOCULA(sys, pos, next);
+    inocula->batch_next = INOCULA(sys, pos, batch_next);
 }
 
 
-/** Creates a new vaccination inoculation in the system
+/** Writes an inoculation at an index
  * @param sys   system structure
- * @param batch   batch structure
- * @param user_name   name of the user
- * @param vacc_name   name of the vaccine
- * @param idiom   language identifier
- * @details Allocates memory for strings and validates allocations and
-prints batch name required
+ * @param pos   index of the record, in an allocated chunk
+ * @param inocula   the record
  */
-void create_inocula(Sys *sys, Batch *batch, char *user_name,
-    char *vacc_name, int idiom) {
-
-    /* allocate and store user/vaccine/batch names */
-    sys->inocula[sys->num_inocula].user_name = strdup(user_name);
-    sys->inocula[sys->num_inocula].vacc_name = strdup(vacc_name);
-    sys->inocula[sys->num_inocula].batch_name = strdup(batch->batch_name);
-
-    /* verify all allocations succeeded */
-    check_allocation(sys->inocula[sys->num_inocula].user_name, idiom);
-    check_allocation(sys->inocula[sys->num_inocula].vacc_name, idiom);
-    check_allocation(sys->inocula[sys->num_inocula].batch_name, idiom);
-
-    sys->inocula[sys->num_inocula].ap_date = sys->today;
-    /* update counters */
-    batch->num_app++;
-    sys->num_inocula++;
-    printf("%s\n", batch->batch_name);
+void store_inocula(Sys *sys, int pos, const Inocula *inocula) {
+    INOCULA(sys, pos, user_id) = inocula->user_id;
+    INOCULA(sys, pos, vacc_id) = inocula->vacc_id;
+    INOCULA(sys, pos, batch_id) = inocula->batch_id;
+    INOCULA(sys, pos, ap_date) = inocula->ap_date;
+    INOCULA(sys, pos, next) = inocula->next;
+    INOCULA(sys, pos, batch_next) = inocula->batch_next;
 }
 
 
-/** Checks if user was already vaccinated with same vaccine today
+/** Moves the records of a chunk one index up, column by column
+ * @param chunk   chunk of records
+ * @param start   first index moved
+ * @param end   index past the last one moved, at most CHUNKSIZE - 1
+ */
+static void move_chunk_up(InoculaChunk *chunk, int start, int end) {
+    int count = end - start;
+
+    memmove(&chunk->user_id[start + 1], &chunk->user_id[start],
+        sizeof(int) * count);
+    memmove(&chunk->vacc_id[start + 1], &chunk->vacc_id[start],
+        sizeof(int) * count);
+    memmove(&chunk->batch_id[start + 1], &chunk->batch_id[start],
+        sizeof(int) * count);
+    memmove(&chunk->ap_date[start + 1], &chunk->ap_date[start],
+        sizeof(Date) * count);
+    memmove(&chunk->next[start + 1], &chunk->next[start],
+        sizeof(int) * count);
+    memmove(&chunk->batch_next[start + 1], &chunk->batch_next[start],
+        sizeof(int) * count);
+}
+
+
+/** Shifts the records from pos onwards one index up
  * @param sys   system structure
- * @param user_name   name of the user
- * @param vacc_name   name of the vaccine
- * @return  1 if duplicate found, 0 otherwise
+ * @param pos   index that becomes free
+ * @details Moves at most one record across each chunk boundary; the slot
+at num_inocula must already be allocated
  */
-int is_already_vaccinated(Sys *sys, char *user_name, char *vacc_name) {
-    for (int i = 0; i < sys->num_inocula; i++) {
-        if (strcmp(sys->inocula[i].user_name, user_name) == 0 &&
-            strcmp(sys->inocula[i].vacc_name, vacc_name) == 0 &&
-            sys->today.year == sys->inocula[i].ap_date.year &&
-            sys->today.month == sys->inocula[i].ap_date.month &&
-            sys->today.day == sys->inocula[i].ap_date.day) {
-            return 1;
+static void shift_inoculas(Sys *sys, int pos) {
+    int last = sys->num_inocula;
+
+    /* walk back from the last chunk, so no record is overwritten */
+    for (int c = last >> CHUNKBITS; c >= pos >> CHUNKBITS; c--) {
+        int start = (c == pos >> CHUNKBITS) ? (pos & (CHUNKSIZE - 1)) : 0;
+        int end = (c == last >> CHUNKBITS) ?
+            (last & (CHUNKSIZE - 1)) : CHUNKSIZE - 1;
+
+        move_chunk_up(sys->chunks[c], start, end);
+        if (c > pos >> CHUNKBITS) { /* carry in the previous chunk's last */
+            Inocula carried;
+            load_inocula(sys, c * CHUNKSIZE - 1, &carried);
+            store_inocula(sys, c * CHUNKSIZE, &carried);
         }
     }
-    return 0;
 }
 
 
-/** Compares two inoculations by application date
- * @param a   first inoculation
- * @param b   second inoculation
- * @details Uses ord_date() for chronological comparison
- * @return  negative if a is earlier, positive if a is later,
-0 if same application date
+/** Finds the first record applied after a date
+ * @param sys   system structure
+ * @param date   date searched (any packed value, valid or not)
+ * @details Binary search on the date column, which is kept sorted. A new
+record goes there, so records of the same day keep their insertion order;
+as time only moves forward this is almost always the end of the array
+ * @return  index of that record, num_inocula if there is none
  */
-int ord_inoculas(Inocula *a, Inocula *b) {
-    int cmp = ord_date(&a->ap_date, &b->ap_date);
-    return cmp;
+int date_position(Sys *sys, Date date) {
+    int lo = 0, hi = sys->num_inocula;
+
+    /* fast path: appending keeps the order */
+    if (hi == 0 || INOCULA(sys, hi - 1, ap_date) <= date) {
+        return hi;
+    }
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (INOCULA(sys, mid, ap_date) <= date) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
 }
 
 
-/** Sorts inoculations by application date (ascending)
- * @param inocula   array of Inocula structures
- * @param num_inocula   number of inoculations
+/** Creates a new vaccination inoculation in the system
+ * @param sys   system structure
+ * @param slot   slot of the batch the dose came from
+ * @param user_name   name of the user
+ * @param vacc_name   name of the vaccine
+ * @details Interns the user/vaccine names. The record is stored in
+application date order; counting it in its batch is left to the caller
  */
-void sort_inoculas(Inocula *inocula, int num_inocula) {
-    /* outer loop: control the number of passes through the array */
-    for (int i = 0; i < num_inocula - 1; i++) {
-        /* inner loop: handles the comparisons and swaps */
-        for (int j = 0; j < num_inocula - i - 1; j++) {
-            if (ord_inoculas(&inocula[j], &inocula[j + 1]) > 0) {
-                /* swap if out of order */
-                Inocula temp = inocula[j];
-                inocula[j] = inocula[j + 1];
-                inocula[j + 1] = temp;
-            }
-        }
+void create_inocula(Sys *sys, int slot, const char *user_name,
+    const char *vacc_name) {
+    Inocula record;
+    int pos;
+
+    /* store IDs of user/vaccine/batch names */
+    record.user_id = intern(&sys->names, user_name);
+    record.vacc_id = intern(&sys->names, vacc_name);
+    record.batch_id = sys->batches[slot].batch_id;
+    record.ap_date = sys->today;
+
+    pos = date_position(sys, record.ap_date);
+    record.next = record.batch_next = NIL;
+    if (pos == sys->num_inocula) { /* append to the user's and batch's lists */
+        store_inocula(sys, pos, &record);
+        sys->num_inocula++;
+        link_user_record(sys, pos);
+        link_batch_record(sys, pos, slot);
+    } else { /* open a gap, moving records renumbers the lists */
+        shift_inoculas(sys, pos);
+        store_inocula(sys, pos, &record);
+        sys->num_inocula++;
+        rebuild_user_index(sys);
+        rebuild_batch_index(sys);
+    }
+    add_dose_key(sys, &record);
+}
+
+
+/** Checks if user was already vaccinated with same vaccine today
+ * @param sys   system structure
+ * @param user_name   name of the user
+ * @param vacc_name   name of the vaccine
+ * @details Constant time lookup in the dose set
+ * @return  1 if duplicate found, 0 otherwise
+ */
+int is_already_vaccinated(Sys *sys, const char *user_name,
+    const char *vacc_name) {
+    int user_id = find_name(&sys->names, user_name);
+    int vacc_id = find_name(&sys->names, vacc_name);
+
+    /* names never seen cannot be in any record */
+    if (user_id == NIL || vacc_id == NIL) {
+        return 0;
     }
+    return has_dose_key(sys, user_id, vacc_id, &sys->today);
 }
 
 
 /** Prints inoculation information in required format
- * @param inocula   inoculation structure
+ * @param inocula   record as listed by list_records()
  * @details Format: <user_name> <batch_name> <DD-MM-YY>
  */
-void print_inocula_info(const Inocula *inocula) {
-    printf("%s %s %02d-%02d-%02d\n",
-           inocula->user_name,
-           inocula->batch_name,
-           inocula->ap_date.day,
-           inocula->ap_date.month,
-           inocula->ap_date.year);
+void print_inocula_info(const RecordInfo *inocula) {
+    write_str(inocula->user_name);
+    write_char(' ');
+    write_str(inocula->batch_name);
+    write_char(' ');
+    write_date(&inocula->ap_date);
+    write_char('\n');
 }
 
 
@@ -386,13 +449,10 @@ void print_inocula_info(const Inocula *inocula) {
  * @param user_name   name of the user
  * @return  1 if user found, 0 if no recors exist
  */
-int is_user_found(Sys *sys, char *user_name) {
-    for (int i = 0; i < sys->num_inocula; i++) {
-        if (strcmp(sys->inocula[i].user_name, user_name) == 0) {
-            return 1;
-        }
-    }
-    return 0;
+int is_user_found(Sys *sys, const char *user_name) {
+    int user = find_user(sys, user_name);
+
+    return user != NIL && sys->users[user].count > 0;
 }
 
 
@@ -401,44 +461,35 @@ int is_user_found(Sys *sys, char *user_name) {
  * @param batch_name   name of the batch
  * @return  1 if batch exists, 0 if not found
  */
-int is_batch_found(Sys *sys, char *batch_name) {
-    for (int i = 0; i < sys->num_batch; i++) {
-        if (strcmp(sys->batches[i].batch_name, batch_name) == 0) {
-            return 1; /* batch exists */
-        }
-    }
-    return 0;
+int is_batch_found(Sys *sys, const char *batch_name) {
+    return find_batch(sys, batch_name) != NIL;
 }
 
 
 /** Determines if an inoculation record should be deleted based on criteria
- * @param inocula   inoculation structure
- * @param user_name   name of the user
- * @param num_param   number of parameters provided
- * @param day   day of the date
- * @param month   month of the date
- * @param year   year of the date
- * @param batch_name   name of the batch
- * @details Checks user match plus optional date and batch filters
+ * @param sys   system structure
+ * @param pos   index of the record
+ * @param user_id   ID of name of the user
+ * @param date   date of the records (NULL for any)
+ * @param batch_id   ID of name of the batch (NIL for any)
+ * @details Checks user match plus optional date and batch filters, reading
+only the columns it needs
  * @return   1 if record should be deleted, 0 otherwise
  */
-int delete_inocula(const Inocula *inocula, const char *user_name,
-    int num_param, int day, int month, int year, const char *batch_name) {
+int delete_inocula(Sys *sys, int pos, int user_id, const Date *date,
+    int batch_id) {
 
     /* check user match */
-    if (strcmp(inocula->user_name, user_name) != 0) {
+    if (INOCULA(sys, pos, user_id) != user_id) {
         return 0; /* skip if wrong user */
     }
 
     /* check date and batch match if provided */
-    int matches_date = (num_param < 3) ||
-        (inocula->ap_date.year == year &&
-         inocula->ap_date.month == month &&
-         inocula->ap_date.day == day);
+    int matches_date = date == NULL || INOCULA(sys, pos, ap_date) == *date;
 
     /* check batch match if provided */
-    int matches_batch = (num_param < 5) ||
-        (strcmp(inocula->batch_name, batch_name) == 0);
+    int matches_batch = batch_id == NIL ||
+        (INOCULA(sys, pos, batch_id) == batch_id);
 
     /* both filters must pass */
     return matches_date && matches_batch;
@@ -450,46 +501,67 @@ int delete_inocula(const Inocula *inocula, const char *user_name,
  * @param sys   system structure
  * @return   1 if future date, 0 if current or past date
  */
- int is_future_date(Date *date, Sys *sys) {
-    Date current_date = sys->today;
-
-    if (date->year > current_date.year) {
-        return 1;
-    }
-    if (date->year == current_date.year && date->month > current_date.month) {
-        return 1;
-    }
-    if (date->year == current_date.year && 
-        date->month == current_date.month && 
-        date->day > current_date.day) {
-        return 1;
-    }
-    return 0;
+ int is_future_date(const Date *date, Sys *sys) {
+    return *date > sys->today;
 }
 
 
-/** Frees memory allocated for an inoculation record
- * @param inocula   inoculation structure
+/** Releases an inoculation record
+ * @param sys   system structure
+ * @param pos   index of the record
+ * @details The record stays in place, marked deleted by a NIL user
  */
-void free_inocula(Inocula *inocula) {
-    free(inocula->user_name);
-    free(inocula->vacc_name);
-    free(inocula->batch_name);
+void free_inocula(Sys *sys, int pos) {
+    INOCULA(sys, pos, user_id) = NIL;
 }
 
 
 /** Initializes system with default values
  * @param sys   system structure
+ * @param idiom   language identifier, for the out-of-memory message
+ * @details Batches and vaccine stock live in the batch arena; inoculations,
+their indexes and the names in the record arena
  */
-void set_system(Sys *sys) {
-    sys->mem_capacity = 10; /* initial capacity for batches/ inoculations */
+void set_system(Sys *sys, int idiom) {
+    set_arena(&sys->batch_arena, idiom);
+    set_arena(&sys->record_arena, idiom);
+
+    /* initial capacity for batches, inoculations get chunks on demand */
+    sys->batch_capacity = 10;
+    sys->batch_growth = BATCHGROWTH;
+    sys->batches = arena_alloc(&sys->batch_arena,
+        sizeof(Batch) * sys->batch_capacity);
+    sys->num_chunks = 0;
+    sys->chunk_capacity = 0;
+    sys->inocula_growth = INOCULAGROWTH;
+    sys->chunks = NULL;
     sys->num_batch = 0;
+    sys->top_batch = 0;
+    sys->free_batch = NIL;
+    sys->batch_root = NIL;
     sys->num_inocula = 0;
+    sys->num_dead = 0;
+    sys->num_vacc = 0;
+    sys->vacc_capacity = 0;
+    sys->vaccines = NULL;
+    sys->vacc_table_size = 0;
+    sys->vacc_table = NULL;
+    sys->dose_set_size = 0;
+    sys->dose_set_used = 0;
+    sys->dose_set_live = 0;
+    sys->dose_set = NULL;
+    sys->dose_spare = NULL;
+    sys->lsn = 0;
+    sys->snap_map = NULL;
+    sys->snap_size = 0;
+    sys->user_capacity = 0;
+    sys->users = NULL;
+    set_names(&sys->names, &sys->record_arena);
 
     /* set default system date */
-    sys->today.day = 1;
-    sys->today.month = 1;
-    sys->today.year = 2025;
+    sys->today = DATE(1, 1, 2025);
+    sys->last_expiry.batches = sys->total_expiry.batches = 0;
+    sys->last_expiry.doses = sys->total_expiry.doses = 0;
 
     /* initialize batch counters */
     for (int i = 0; i < sys->num_batch; i++) {
@@ -501,19 +573,16 @@ void set_system(Sys *sys) {
 
 /** Releases all dynamically allocated system memory
  * @param sys   system structure
+ * @details Everything lives in the two arenas or the loaded snapshot, so
+this only frees their blocks and unmaps the snapshot
  */
 void free_system(Sys *sys) {
-    for (int i = 0; i < sys->num_batch; i++) {
-        free(sys->batches[i].batch_name);
-        free(sys->batches[i].vacc_name);
-    }
-    for (int i = 0; i < sys->num_inocula; i++) {
-        free(sys->inocula[i].user_name);
-        free(sys->inocula[i].vacc_name);
-        free(sys->inocula[i].batch_name);
+    free_arena(&sys->batch_arena);
+    free_arena(&sys->record_arena);
+    if (sys->snap_map != NULL) {
+        munmap(sys->snap_map, sys->snap_size);
+        sys->snap_map = NULL;
     }
-    free(sys->batches);
-    free(sys->inocula);
 }
 
 
@@ -523,7 +592,8 @@ void free_system(Sys *sys) {
  */
 void check_allocation(void *ptr, int idiom) {
     if (ptr == NULL) {
-        puts(idiom == 0 ? ENOMEMORY : ENOMEMORYPT);
+        write_line(idiom == 0 ? ENOMEMORY : ENOMEMORYPT);
+        flush_output();
         exit(EXITNOMEM);
     }
 }
\ No newline at end of file
@@ -0,0 +1,158 @@
+/**
+ * Vaccination Management System - Benchmark Harness
+ * @brief: Runs a command file through the interpreter in-process and
+ * reports:
+ * - Throughput, in commands per second
+ * - Per-command latency percentiles
+ * Answers are formatted as usual but dropped instead of written.
+ * Build: gcc -O2 -pthread -o harness bench/harness.c arena.c aux.c epoch.c
+ * filter.c import.c index.c intern.c io.c parse.c shard.c snapshot.c stats.c
+ * stock.c tree.c vaccine.c wal.c
+ * Usage: harness [-l snapshot] commands-file
+ * @file: harness.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <time.h>
+
+/* the interpreter's own main loop pieces, with its main() set aside */
+#define main project_main
+#include "../project.c"
+#undef main
+
+#define NUMKINDS 128        /**< command letters tracked */
+
+/** latencies of one kind of command */
+typedef struct {
+    long count;     /**< commands run */
+    long cap;       /**< allocated size of ns */
+    long long *ns;      /**< latency of each command, in nanoseconds */
+    long long total;        /**< sum of ns */
+} Latencies;
+
+
+/** Current time, in nanoseconds
+ * @return  nanoseconds on a monotonic clock
+ */
+static long long now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/** Records the latency of a command
+ * @param lat   latencies of its kind
+ * @param ns   latency, in nanoseconds
+ */
+static void add_latency(Latencies *lat, long long ns) {
+    if (lat->count == lat->cap) {
+        lat->cap = lat->cap ? lat->cap * 2 : 1024;
+        lat->ns = realloc(lat->ns, sizeof(long long) * lat->cap);
+        check_allocation(lat->ns, 0);
+    }
+    lat->ns[lat->count++] = ns;
+    lat->total += ns;
+}
+
+
+/** Compares two latencies, for qsort()
+ * @return  negative, zero or positive as a is below, equal or above b
+ */
+static int cmp_latency(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/** Returns a percentile of sorted latencies
+ * @param lat   latencies, sorted
+ * @param p   percentile, 0 to 100
+ * @return  latency, in nanoseconds
+ */
+static long long percentile(const Latencies *lat, double p) {
+    long i = (long)(p / 100.0 * (lat->count - 1) + 0.5);
+
+    return lat->ns[i];
+}
+
+
+/** Prints the report of one kind of command
+ * @param name   label of the line
+ * @param lat   latencies, sorted here
+ */
+static void report(const char *name, Latencies *lat) {
+    qsort(lat->ns, lat->count, sizeof(long long), cmp_latency);
+    printf("%-6s %10ld %9.0f %9lld %9lld %9lld %9lld %11lld\n", name,
+        lat->count, (double)lat->total / lat->count, percentile(lat, 50),
+        percentile(lat, 90), percentile(lat, 99), percentile(lat, 99.9),
+        lat->ns[lat->count - 1]);
+}
+
+
+/** Benchmark entry point
+ * @return  0, or 1 on bad arguments or files
+ */
+int main(int argc, char *argv[]) {
+    static Latencies kinds[NUMKINDS], all;
+    const char *load = NULL, *path = NULL;
+    long long start, elapsed;
+    Reader in;
+    Sys sys;
+    char *line;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            load = argv[++i];
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "usage: %s [-l snapshot] commands-file\n", argv[0]);
+        return 1;
+    }
+    if (open_input(&in, path, 0)) {
+        fprintf(stderr, "%s: %s\n", path, ENOFILE);
+        return 1;
+    }
+    set_system(&sys, 0);
+    if (load != NULL && load_snapshot(&sys, load)) {
+        fprintf(stderr, "%s: %s\n", load, EINVSNAP);
+        return 1;
+    }
+    mute_output(1);
+
+    start = now_ns();
+    while ((line = read_line(&in)) != NULL && line[0] != 'q') {
+        int kind = (unsigned char)line[0] % NUMKINDS;
+        long long t = now_ns(), ns;
+        run_command(&sys, line, 0);
+        ns = now_ns() - t;
+        add_latency(&kinds[kind], ns);
+        add_latency(&all, ns);
+    }
+    elapsed = now_ns() - start;
+    if (all.count == 0) {
+        fprintf(stderr, "%s: no commands\n", path);
+        return 1;
+    }
+
+    printf("%ld commands in %.3f s: %.0f commands/s\n", all.count,
+        elapsed / 1e9, all.count / (elapsed / 1e9));
+    printf("%-6s %10s %9s %9s %9s %9s %9s %11s\n", "cmd", "count",
+        "mean ns", "p50", "p90", "p99", "p99.9", "max");
+    for (int k = 0; k < NUMKINDS; k++) {
+        if (kinds[k].count > 0) {
+            char name[2] = {(char)k, '\0'};
+            report(name, &kinds[k]);
+            free(kinds[k].ns);
+        }
+    }
+    report("all", &all);
+    free(all.ns);
+    free_system(&sys);
+    close_input(&in);
+    return 0;
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Vaccination Management System - journal benchmark
+# Measures sustained 'a' throughput with the journal off and with group
+# commits of several sizes.
+# usage: journal_bench.sh [binary] [commands] [directory for the journal]
+# @author: ist1114455 (Marta Santos)
+
+BIN=${1:-./project}
+N=${2:-200000}
+DIR=${3:-/tmp}
+INPUT=$DIR/journal_bench.in
+JOURNAL=$DIR/journal_bench.wal
+
+# enough stock for every dose, then one dose per distinct user
+awk -v n="$N" 'BEGIN {
+    for (i = 0; i < 1000; i++) printf "c %X 31-12-2099 %d vacc\n", 4096 + i, n
+    for (i = 0; i < n; i++) printf "a user%d vacc\n", i
+}' > "$INPUT"
+
+now() { date +%s%N; }
+
+run() { # label, then the binary's options
+    label=$1; shift
+    rm -f "$JOURNAL"
+    start=$(now)
+    "$BIN" "$@" "$INPUT" > /dev/null
+    end=$(now)
+    us=$(( (end - start) / 1000 ))
+    [ "$us" -gt 0 ] || us=1
+    echo "$label: $(( N * 1000000 / us )) a/s"
+}
+
+run "no journal"
+for g in 1 16 64 1024; do
+    run "journal, group $g" -j "$JOURNAL" -g "$g"
+done
+rm -f "$INPUT" "$JOURNAL"
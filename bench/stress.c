@@ -0,0 +1,370 @@
+/**
+ * Vaccination Management System - Concurrent Engine Stress Test
+ * @brief: Runs threads administering random doses on one engine while a
+ * writer registers and removes batches and advances the date, and a reader
+ * lists batches and records without locks, then checks:
+ * - No batch gave more doses than it had, and every dose has its record
+ * - No user got the same vaccine twice on the same day
+ * - Every listing the reader saw was consistent
+ * Build: gcc -O2 -pthread -o stress bench/stress.c arena.c aux.c epoch.c
+ * filter.c import.c index.c intern.c io.c parse.c shard.c snapshot.c stats.c
+ * stock.c tree.c vaccine.c wal.c
+ * Usage: stress [-t threads] [-s shards] [-n doses per thread] [-u users]
+ * [-v vaccines] [-b batches per vaccine] [-d doses per batch] [-w rounds]
+ * @file: stress.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../project.h"
+
+/** settings of the run */
+static int num_threads = 8, num_shards = 64, num_users = 20000;
+static int num_vaccs = 4, num_batches = 50, batch_doses = 500, rounds = 20;
+static long per_thread = 200000;
+
+static Engine engine;       /**< the engine under test */
+static int num_made;        /**< batches registered so far */
+static int applied_at[MAXBATCH];      /**< doses applied when removed */
+static int removed[MAXBATCH];     /**< 1 if the batch was removed */
+static int running = 1;     /**< cleared when the workers are done */
+static long polls, bad_polls;       /**< reader listings, wrong ones */
+
+/** work and results of one administering thread */
+typedef struct {
+    pthread_t thread;
+    unsigned long long seed;        /**< state of its PRNG */
+    long results[ERRNOSUSER + 1];       /**< calls by result code */
+} Worker;
+
+
+/** Returns a pseudo-random 64-bit number (xorshift64*)
+ * @param state   PRNG state, advanced
+ * @return  random number
+ */
+static unsigned long long next_random(unsigned long long *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+
+/** Moves a date some days forward, with the system's calendar
+ * @param date   date to move
+ * @param days   number of days
+ */
+static void add_days(Date *date, int days) {
+    static const int days_in_month[] = {0, 31, 28, 31, 30, 31, 30, 31, 31,
+        30, 31, 30, 31};
+
+    int day = DATEDAY(*date) + days, month = DATEMONTH(*date);
+    int year = DATEYEAR(*date);
+
+    while (day > days_in_month[month]) {
+        day -= days_in_month[month];
+        if (++month > 12) {
+            month = 1;
+            year++;
+        }
+    }
+    *date = DATE(day, month, year);
+}
+
+
+/** Registers a batch of a vaccine, named after its number
+ * @param vacc   vaccine number
+ * @param shelf   days until it expires
+ */
+static void make_batch(int vacc, int shelf) {
+    char batch_name[16], vacc_name[16];
+    Date exp_date = engine.catalog.today;
+
+    add_days(&exp_date, shelf);
+    sprintf(batch_name, "%X", num_made++);
+    sprintf(vacc_name, "vacc%d", vacc);
+    if (engine_add_batch(&engine, batch_name, &exp_date, batch_doses,
+        vacc_name) != ERRNONE) {
+        fprintf(stderr, "cannot register batch %s\n", batch_name);
+        exit(1);
+    }
+}
+
+
+/** Administers random doses
+ * @param arg   its Worker
+ * @return  NULL
+ */
+static void *administer_doses(void *arg) {
+    Worker *worker = arg;
+    char user_name[32], vacc_name[16];
+
+    for (long i = 0; i < per_thread; i++) {
+        unsigned long long r = next_random(&worker->seed);
+        sprintf(user_name, "user%d", (int)(r % num_users));
+        sprintf(vacc_name, "vacc%d", (int)(r / num_users % num_vaccs));
+        worker->results[engine_administer(&engine, user_name, vacc_name,
+            NULL)]++;
+    }
+    return NULL;
+}
+
+
+/** Changes the catalog while the doses are being administered
+ * @param arg   unused
+ * @details Each round adds a batch of every vaccine, removes the oldest
+batch still registered and moves one day forward
+ * @return  NULL
+ */
+static void *change_catalog(void *arg) {
+    struct timespec pause = {0, 2000000};
+    int oldest = 0;
+
+    (void)arg;
+    for (int round = 0; round < rounds; round++) {
+        char batch_name[16];
+        Date tomorrow = engine.catalog.today;
+
+        nanosleep(&pause, NULL);
+        for (int v = 0; v < num_vaccs; v++) {
+            make_batch(v, 30);
+        }
+        sprintf(batch_name, "%X", oldest);
+        engine_remove_batch(&engine, batch_name, &applied_at[oldest]);
+        removed[oldest++] = 1;
+        add_days(&tomorrow, 1);
+        engine_advance_date(&engine, &tomorrow);
+    }
+    return NULL;
+}
+
+
+/** Orders two dose keys, for qsort()
+ * @return  negative, zero or positive as a is before, equal or after b
+ */
+static int cmp_keys(const void *a, const void *b) {
+    const int *x = a, *y = b;
+
+    for (int i = 0; i < 3; i++) {
+        if (x[i] != y[i]) {
+            return (x[i] > y[i]) - (x[i] < y[i]);
+        }
+    }
+    return 0;
+}
+
+
+/** Checks a batch seen by the reader
+ * @param info   the batch
+ * @param ctx   unused
+ * @return  always 0, to see every batch
+ */
+static int poll_batch(const BatchInfo *info, void *ctx) {
+    (void)ctx;
+    if (info->doses < 0 || info->num_app < 0 ||
+        info->doses + info->num_app > batch_doses) {
+        bad_polls++;
+    }
+    return 0;
+}
+
+
+/** Checks that the records seen by the reader come in date order
+ * @param info   the record
+ * @param ctx   date of the record before
+ * @return  always 0, to see every record
+ */
+static int poll_record(const RecordInfo *info, void *ctx) {
+    Date *last = ctx;
+
+    if (info->ap_date < *last) {
+        bad_polls++;
+    }
+    *last = info->ap_date;
+    return 0;
+}
+
+
+/** Lists batches and records, as a dashboard would, until the end
+ * @param arg   unused
+ * @return  NULL
+ */
+static void *poll_listings(void *arg) {
+    unsigned long long seed = 0x9E3779B97F4A7C15ull;
+    char user_name[32];
+
+    (void)arg;
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        Date last = 0;
+        engine_list_batches(&engine, NULL, poll_batch, NULL);
+        sprintf(user_name, "user%d", (int)(next_random(&seed) % num_users));
+        engine_list_records(&engine, user_name, poll_record, &last);
+        polls++;
+    }
+    return NULL;
+}
+
+
+/** Final state of the batches, as listed */
+static int listed_doses[MAXBATCH], listed_app[MAXBATCH], listed[MAXBATCH];
+
+
+/** Keeps the final state of a batch
+ * @param info   the batch
+ * @param ctx   unused
+ * @return  always 0, to see every batch
+ */
+static int keep_batch(const BatchInfo *info, void *ctx) {
+    int i = (int)strtol(info->batch_name, NULL, 16);
+
+    (void)ctx;
+    listed[i] = 1;
+    listed_doses[i] = info->doses;
+    listed_app[i] = info->num_app;
+    return 0;
+}
+
+
+/** Checks the batches and the records after the run
+ * @param doses_given   successful administrations reported by the threads
+ * @return  number of violations found
+ */
+static int check_engine(long doses_given) {
+    long applied = 0, records = 0;
+    int errors = 0;
+
+    engine_list_batches(&engine, NULL, keep_batch, NULL);
+    for (int i = 0; i < num_made; i++) {
+        if (!listed[i]) {
+            if (!removed[i] || applied_at[i] != 0) {
+                printf("batch %X: missing\n", i);
+                errors++;
+            }
+            continue;
+        }
+        applied += listed_app[i];
+        if (listed_doses[i] < 0 || (removed[i] ?
+            listed_app[i] != applied_at[i] || listed_doses[i] != 0 :
+            listed_doses[i] + listed_app[i] != batch_doses)) {
+            printf("batch %X: %d doses left, %d applied\n", i,
+                listed_doses[i], listed_app[i]);
+            errors++;
+        }
+    }
+    for (int s = 0; s < engine.num_shards; s++) {
+        Sys *sys = &engine.shards[s].sys;
+        RecordLog *log = &engine.shards[s].log;
+        int *keys = malloc(sizeof(int) * 3 * (log->len + 1)), n = 0;
+
+        for (int i = 0; i < log->len; i++) {
+            RecordInfo *info = &log->chunks[i >> LOGBITS][i & (LOGCHUNK - 1)]
+                .info;
+            keys[3 * n] = find_name(&sys->names, info->user_name);
+            keys[3 * n + 1] = find_name(&sys->names, info->vacc_name);
+            keys[3 * n + 2] = info->ap_date;
+            n++;
+        }
+        qsort(keys, n, sizeof(int) * 3, cmp_keys);
+        for (int i = 1; i < n; i++) {
+            if (cmp_keys(&keys[3 * i - 3], &keys[3 * i]) == 0) {
+                printf("shard %d: %s vaccinated twice with %s\n", s,
+                    name_of(&sys->names, keys[3 * i]),
+                    name_of(&sys->names, keys[3 * i + 1]));
+                errors++;
+            }
+        }
+        records += n;
+        free(keys);
+    }
+    if (applied != doses_given || records != doses_given) {
+        printf("%ld doses given, %ld applied, %ld records\n", doses_given,
+            applied, records);
+        errors++;
+    }
+    if (bad_polls != 0) {
+        printf("%ld of %ld listings inconsistent\n", bad_polls, polls);
+        errors++;
+    }
+    return errors;
+}
+
+
+/** Stress test entry point
+ * @return  0 if every check passed, 1 otherwise
+ */
+int main(int argc, char *argv[]) {
+    struct timespec start, end;
+    pthread_t writer, reader;
+    Worker *workers;
+    long totals[ERRNOSUSER + 1] = {0};
+    double elapsed;
+    int errors;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        int value = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "-t") == 0) num_threads = value;
+        else if (strcmp(argv[i], "-s") == 0) num_shards = value;
+        else if (strcmp(argv[i], "-n") == 0) per_thread = atol(argv[i + 1]);
+        else if (strcmp(argv[i], "-u") == 0) num_users = value;
+        else if (strcmp(argv[i], "-v") == 0) num_vaccs = value;
+        else if (strcmp(argv[i], "-b") == 0) num_batches = value;
+        else if (strcmp(argv[i], "-d") == 0) batch_doses = value;
+        else if (strcmp(argv[i], "-w") == 0) rounds = value;
+        else {
+            fprintf(stderr, "usage: %s [-t threads] [-s shards] [-n doses] "
+                "[-u users] [-v vaccines] [-b batches] [-d doses] "
+                "[-w rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (num_threads < 1 || num_users < 1 || num_vaccs < 1 ||
+        num_vaccs * (num_batches + rounds) > MAXBATCH) {
+        fprintf(stderr, "%s: bad settings\n", argv[0]);
+        return 1;
+    }
+
+    set_engine(&engine, num_shards, 0);
+    for (int b = 0; b < num_batches; b++) {
+        for (int v = 0; v < num_vaccs; v++) {
+            make_batch(v, 1 + b % 40);
+        }
+    }
+    workers = calloc(num_threads, sizeof(Worker));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < num_threads; i++) {
+        workers[i].seed = 88172645463325252ull + 2 * i + 1;
+        pthread_create(&workers[i].thread, NULL, administer_doses,
+            &workers[i]);
+    }
+    pthread_create(&writer, NULL, change_catalog, NULL);
+    pthread_create(&reader, NULL, poll_listings, NULL);
+    pthread_join(writer, NULL);
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        for (int r = 0; r <= ERRNOSUSER; r++) {
+            totals[r] += workers[i].results[r];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+    pthread_join(reader, NULL);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)
+        / 1e9;
+
+    printf("%d threads, %d shards: %ld calls in %.3f s, %.0f calls/s\n",
+        num_threads, engine.num_shards, num_threads * per_thread, elapsed,
+        num_threads * per_thread / elapsed);
+    printf("given %ld, already vaccinated %ld, no stock %ld\n",
+        totals[ERRNONE], totals[ERRALRVACC], totals[ERRNOSTOCK]);
+    printf("%ld lock-free listings of batches and records\n", polls);
+    errors = check_engine(totals[ERRNONE]);
+    printf(errors == 0 ? "all checks passed\n" : "%d checks failed\n",
+        errors);
+    free(workers);
+    free_engine(&engine);
+    return errors != 0;
+}
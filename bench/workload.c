@@ -0,0 +1,299 @@
+/**
+ * Vaccination Management System - Workload Generator
+ * @brief: Emits a synthetic command stream for the benchmarks:
+ * - Configurable ratios of c/a/l/u/d/r/t commands
+ * - Zipf-distributed users and vaccines
+ * - Batches expiring 30 to 365 days after the current date
+ * Build: gcc -O2 -o workload bench/workload.c -lm
+ * Usage: workload [-n commands] [-s seed] [-u users] [-v vaccines]
+ * [-z zipf exponent] [-r c=5,a=70,l=2,u=10,d=5,r=3,t=5]
+ * @file: workload.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define NUMCOMMANDS 7       /**< kinds of commands generated */
+#define MAXLIVE 900     /**< batches kept below the system limit */
+#define MINSHELF 30     /**< min. days until a new batch expires */
+#define MAXSHELF 365        /**< max. days until a new batch expires */
+
+static const char commands[] = "caludrt";      /**< in the order of ratios */
+
+/* default ratios, in the order of commands */
+static int ratios[NUMCOMMANDS] = {5, 70, 2, 10, 5, 3, 5};
+
+/** represents a date in day-month-year format */
+typedef struct {
+    int day, month, year;
+} Date;
+
+
+/** Zipf distribution over 0..n-1, sampled by inverting its CDF */
+typedef struct {
+    int n;      /**< number of items */
+    double *cdf;        /**< cumulative probability of each item */
+} Zipf;
+
+
+static unsigned long long rng_state = 88172645463325252ull;     /**< PRNG */
+
+
+/** Returns a pseudo-random 64-bit number (xorshift64*)
+ * @return  random number
+ */
+static unsigned long long next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+
+/** Returns a random number in [0, n)
+ * @param n   upper bound
+ * @return  random number
+ */
+static int random_below(int n) {
+    return (int)(next_random() % (unsigned long long)n);
+}
+
+
+/** Returns a random number in [0, 1)
+ * @return  random number
+ */
+static double random_unit(void) {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+/** Builds a Zipf distribution
+ * @param zipf   distribution
+ * @param n   number of items
+ * @param s   exponent (0 is uniform)
+ */
+static void set_zipf(Zipf *zipf, int n, double s) {
+    double sum = 0;
+
+    zipf->n = n;
+    zipf->cdf = malloc(sizeof(double) * n);
+    if (zipf->cdf == NULL) {
+        fprintf(stderr, "No memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        sum += 1.0 / pow(i + 1, s);
+        zipf->cdf[i] = sum;
+    }
+    for (int i = 0; i < n; i++) {
+        zipf->cdf[i] /= sum;
+    }
+}
+
+
+/** Draws an item from a Zipf distribution
+ * @param zipf   distribution
+ * @return  item, 0 being the most frequent
+ */
+static int draw_zipf(const Zipf *zipf) {
+    double u = random_unit();
+    int lo = 0, hi = zipf->n - 1;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (zipf->cdf[mid] < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+/** Moves a date some days forward, with the system's calendar (no leap
+years)
+ * @param date   date to move
+ * @param days   number of days
+ */
+static void add_days(Date *date, int days) {
+    static const int days_in_month[] = {0, 31, 28, 31, 30, 31, 30, 31, 31,
+        30, 31, 30, 31};
+
+    date->day += days;
+    while (date->day > days_in_month[date->month]) {
+        date->day -= days_in_month[date->month];
+        if (++date->month > 12) {
+            date->month = 1;
+            date->year++;
+        }
+    }
+}
+
+
+/** Prints a user name; one user in ten has a quoted name with a space
+ * @param user   user number
+ */
+static void print_user(int user) {
+    if (user % 10 == 9) {
+        printf("\"user %d\"", user);
+    } else {
+        printf("user%d", user);
+    }
+}
+
+
+/** Parses the command ratios
+ * @param spec   ratios as "c=5,a=70,..."
+ * @return  0 if parsed, 1 otherwise
+ */
+static int parse_ratios(const char *spec) {
+    while (*spec != '\0') {
+        const char *found = strchr(commands, *spec);
+        int value;
+        char *end;
+
+        if (found == NULL || *found == '\0' || spec[1] != '=') {
+            return 1;
+        }
+        value = (int)strtol(spec + 2, &end, 10);
+        if (end == spec + 2 || value < 0) {
+            return 1;
+        }
+        ratios[found - commands] = value;
+        spec = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+
+
+/** Draws the next command by the ratios
+ * @param total   sum of the ratios
+ * @return  command letter
+ */
+static char draw_command(int total) {
+    int r = random_below(total);
+
+    for (int i = 0; i < NUMCOMMANDS; i++) {
+        if (r < ratios[i]) {
+            return commands[i];
+        }
+        r -= ratios[i];
+    }
+    return commands[NUMCOMMANDS - 1];
+}
+
+
+/** Main program, writes the command stream to stdout
+ * @return  0, or 1 on bad arguments
+ */
+int main(int argc, char *argv[]) {
+    long count = 1000000;
+    int num_users = 100000, num_vaccs = 20, total = 0;
+    double exponent = 1.0;
+    Zipf users, vaccs;
+    Date today = {1, 1, 2025};
+    int *live, num_live = 0, next_batch = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            count = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            rng_state = strtoull(argv[i + 1], NULL, 10) * 2 + 1;
+        } else if (strcmp(argv[i], "-u") == 0) {
+            num_users = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            num_vaccs = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-z") == 0) {
+            exponent = atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "-r") != 0 || parse_ratios(argv[i + 1])) {
+            fprintf(stderr, "usage: %s [-n commands] [-s seed] [-u users] "
+                "[-v vaccines] [-z exponent] [-r c=5,a=70,...]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (int i = 0; i < NUMCOMMANDS; i++) {
+        total += ratios[i];
+    }
+    if (num_users < 1 || num_vaccs < 1 || total == 0) {
+        fprintf(stderr, "%s: nothing to generate\n", argv[0]);
+        return 1;
+    }
+    set_zipf(&users, num_users, exponent);
+    set_zipf(&vaccs, num_vaccs, exponent);
+    live = malloc(sizeof(int) * MAXLIVE);
+    if (live == NULL) {
+        fprintf(stderr, "No memory\n");
+        return 1;
+    }
+
+    for (long i = 0; i < count; i++) {
+        char command = draw_command(total);
+
+        /* keep the batches within the system limit */
+        if (command == 'c' && num_live == MAXLIVE) {
+            command = 'r';
+        }
+        if (command == 'r' && num_live == 0) {
+            command = 'c';
+        }
+        switch (command) {
+            case 'c': {
+                Date exp_date = today;
+                add_days(&exp_date, MINSHELF +
+                    random_below(MAXSHELF - MINSHELF + 1));
+                live[num_live++] = next_batch;
+                printf("c %X %02d-%02d-%d %d vacc%d\n", next_batch++,
+                    exp_date.day, exp_date.month, exp_date.year,
+                    100 + random_below(900), draw_zipf(&vaccs));
+                break;
+            }
+            case 'a':
+                printf("a ");
+                print_user(draw_zipf(&users));
+                printf(" vacc%d\n", draw_zipf(&vaccs));
+                break;
+            case 'l':
+                if (random_below(2) == 0) {
+                    printf("l\n");
+                } else {
+                    printf("l vacc%d\n", draw_zipf(&vaccs));
+                }
+                break;
+            case 'u':
+                if (random_below(100) == 0) { /* listing everything is rare */
+                    printf("u\n");
+                } else {
+                    printf("u ");
+                    print_user(draw_zipf(&users));
+                    printf("\n");
+                }
+                break;
+            case 'd':
+                printf("d ");
+                print_user(draw_zipf(&users));
+                if (random_below(2) == 0) {
+                    printf(" %02d-%02d-%d", today.day, today.month, today.year);
+                }
+                printf("\n");
+                break;
+            case 'r': {
+                int pos = random_below(num_live);
+                printf("r %X\n", live[pos]);
+                live[pos] = live[--num_live];
+                break;
+            }
+            default: /* 't' */
+                add_days(&today, 1);
+                printf("t %02d-%02d-%d\n", today.day, today.month,
+                    today.year);
+                break;
+        }
+    }
+    free(live);
+    free(users.cdf);
+    free(vaccs.cdf);
+    return 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * Vaccination Management System - Epoch-Based Reclamation
+ * @brief: This file lets readers use published versions without locks:
+ * - A reader announces the epoch it started in, in a slot of its own
+ * - A writer that replaces a version retires the old one, tagged with the
+ * epoch it was retired in, and moves the epoch forward
+ * - Retired versions are released once every reader still running started
+ * after them, as none of those can hold them
+ * @file: epoch.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "project.h"
+
+/** Initializes the epochs, with no reader running
+ * @param epochs   epochs structure
+ */
+void set_epochs(Epochs *epochs) {
+    epochs->global = 1; /* 0 marks an idle reader slot */
+    for (int i = 0; i < EPOCHREADERS; i++) {
+        epochs->readers[i] = 0;
+    }
+}
+
+
+/** Starts a read of published versions
+ * @param epochs   epochs structure
+ * @details Takes an idle reader slot, waiting for one if all EPOCHREADERS
+are busy. Versions loaded after this stay valid until exit_epoch()
+ * @return  the reader slot, for exit_epoch()
+ */
+int enter_epoch(Epochs *epochs) {
+    for (;;) {
+        for (int i = 0; i < EPOCHREADERS; i++) {
+            unsigned long idle = 0;
+            unsigned long now = __atomic_load_n(&epochs->global,
+                __ATOMIC_SEQ_CST);
+            if (__atomic_compare_exchange_n(&epochs->readers[i], &idle, now,
+                0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                return i;
+            }
+        }
+    }
+}
+
+
+/** Ends a read started by enter_epoch()
+ * @param epochs   epochs structure
+ * @param slot   reader slot
+ */
+void exit_epoch(Epochs *epochs, int slot) {
+    __atomic_store_n(&epochs->readers[slot], 0, __ATOMIC_RELEASE);
+}
+
+
+/** Retires a version that was just replaced
+ * @param epochs   epochs structure
+ * @param list   retired versions of the writer, guarded by its lock
+ * @param ptr   the old version, no longer reachable by new readers
+ * @param release   frees the old version
+ */
+void retire(Epochs *epochs, Retired **list, void *ptr,
+    void (*release)(void *)) {
+    Retired *node = malloc(sizeof(Retired));
+
+    check_allocation(node, 0);
+    node->ptr = ptr;
+    node->release = release;
+    node->epoch = __atomic_fetch_add(&epochs->global, 1, __ATOMIC_SEQ_CST);
+    node->next = *list;
+    *list = node;
+    reclaim(epochs, list);
+}
+
+
+/** Releases the retired versions no reader can hold any more
+ * @param epochs   epochs structure
+ * @param list   retired versions of the writer, guarded by its lock
+ * @details A reader that started in an epoch after a version was retired
+loaded its replacement; with no reader running, everything is released
+ */
+void reclaim(Epochs *epochs, Retired **list) {
+    unsigned long oldest = (unsigned long)-1;
+
+    for (int i = 0; i < EPOCHREADERS; i++) {
+        unsigned long epoch = __atomic_load_n(&epochs->readers[i],
+            __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    while (*list != NULL) {
+        Retired *node = *list;
+        if (node->epoch >= oldest) {
+            list = &node->next;
+            continue;
+        }
+        *list = node->next;
+        node->release(node->ptr);
+        free(node);
+    }
+}
@@ -0,0 +1,213 @@
+/**
+ * Vaccination Management System - Record Filters
+ * @brief: This file contains the scans over the inoculation columns:
+ * - Filter kernels matching user, batch, date and vaccine predicates on a
+ * whole chunk, into a selection bitmap (one bit per record)
+ * - AVX2 (8 records per step) when the CPU has it, SSE2 (4 per step) on
+ * any other x86-64, plain C elsewhere; all give the same bitmap
+ * - Branch-free stream compaction of the columns, driven by the bitmap
+ * @file: filter.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "project.h"
+
+/** Matches records one at a time
+ * @param chunk   chunk of records
+ * @param start   first record
+ * @param count   records in the chunk
+ * @param filter   predicates
+ * @param bits   selection bitmap, bits from start on set or cleared
+ */
+static void filter_scalar(const InoculaChunk *chunk, int start, int count,
+    const RecordFilter *filter, unsigned long long *bits) {
+    for (int i = start; i < count; i++) {
+        unsigned long long match = (filter->user_id == NIL ?
+            chunk->user_id[i] != NIL : chunk->user_id[i] == filter->user_id) &
+            (filter->batch_id == NIL ||
+                chunk->batch_id[i] == filter->batch_id) &
+            (filter->date == 0 || chunk->ap_date[i] == filter->date) &
+            (filter->vacc_id == NIL || chunk->vacc_id[i] == filter->vacc_id);
+        bits[i >> 6] |= match << (i & 63);
+    }
+}
+
+
+#if defined(__x86_64__)
+/** Matches records four at a time, with SSE2
+ * @param chunk   chunk of records
+ * @param count   records in the chunk
+ * @param filter   predicates
+ * @param bits   selection bitmap, cleared
+ */
+static void filter_sse2(const InoculaChunk *chunk, int count,
+    const RecordFilter *filter, unsigned long long *bits) {
+    __m128i user = _mm_set1_epi32(filter->user_id);
+    __m128i batch = _mm_set1_epi32(filter->batch_id);
+    __m128i date = _mm_set1_epi32((int)filter->date);
+    __m128i vacc = _mm_set1_epi32(filter->vacc_id);
+    __m128i ones = _mm_set1_epi32(-1);
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128i users = _mm_loadu_si128((const __m128i *)&chunk->user_id[i]);
+        __m128i match = _mm_cmpeq_epi32(users, user);
+        if (filter->user_id == NIL) { /* any live record */
+            match = _mm_xor_si128(match, ones);
+        }
+        if (filter->batch_id != NIL) {
+            match = _mm_and_si128(match, _mm_cmpeq_epi32(batch,
+                _mm_loadu_si128((const __m128i *)&chunk->batch_id[i])));
+        }
+        if (filter->date != 0) {
+            match = _mm_and_si128(match, _mm_cmpeq_epi32(date,
+                _mm_loadu_si128((const __m128i *)&chunk->ap_date[i])));
+        }
+        if (filter->vacc_id != NIL) {
+            match = _mm_and_si128(match, _mm_cmpeq_epi32(vacc,
+                _mm_loadu_si128((const __m128i *)&chunk->vacc_id[i])));
+        }
+        bits[i >> 6] |= (unsigned long long)_mm_movemask_ps(
+            _mm_castsi128_ps(match)) << (i & 63);
+    }
+    filter_scalar(chunk, i, count, filter, bits);
+}
+
+
+/** Matches records eight at a time, with AVX2
+ * @param chunk   chunk of records
+ * @param count   records in the chunk
+ * @param filter   predicates
+ * @param bits   selection bitmap, cleared
+ */
+__attribute__((target("avx2")))
+static void filter_avx2(const InoculaChunk *chunk, int count,
+    const RecordFilter *filter, unsigned long long *bits) {
+    __m256i user = _mm256_set1_epi32(filter->user_id);
+    __m256i batch = _mm256_set1_epi32(filter->batch_id);
+    __m256i date = _mm256_set1_epi32((int)filter->date);
+    __m256i vacc = _mm256_set1_epi32(filter->vacc_id);
+    __m256i ones = _mm256_set1_epi32(-1);
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m256i users = _mm256_loadu_si256(
+            (const __m256i *)&chunk->user_id[i]);
+        __m256i match = _mm256_cmpeq_epi32(users, user);
+        if (filter->user_id == NIL) { /* any live record */
+            match = _mm256_xor_si256(match, ones);
+        }
+        if (filter->batch_id != NIL) {
+            match = _mm256_and_si256(match, _mm256_cmpeq_epi32(batch,
+                _mm256_loadu_si256((const __m256i *)&chunk->batch_id[i])));
+        }
+        if (filter->date != 0) {
+            match = _mm256_and_si256(match, _mm256_cmpeq_epi32(date,
+                _mm256_loadu_si256((const __m256i *)&chunk->ap_date[i])));
+        }
+        if (filter->vacc_id != NIL) {
+            match = _mm256_and_si256(match, _mm256_cmpeq_epi32(vacc,
+                _mm256_loadu_si256((const __m256i *)&chunk->vacc_id[i])));
+        }
+        bits[i >> 6] |= (unsigned long long)_mm256_movemask_ps(
+            _mm256_castsi256_ps(match)) << (i & 63);
+    }
+    filter_scalar(chunk, i, count, filter, bits);
+}
+#endif
+
+
+/** Selects the records of a chunk that match a filter
+ * @param chunk   chunk of records
+ * @param count   records in use in the chunk (at most CHUNKSIZE)
+ * @param filter   predicates
+ * @param bits   receives the selection bitmap, CHUNKWORDS words; bits from
+count on are 0
+ * @details Picks the widest kernel the CPU runs
+ */
+void filter_chunk(const InoculaChunk *chunk, int count,
+    const RecordFilter *filter, unsigned long long *bits) {
+    memset(bits, 0, sizeof(unsigned long long) * CHUNKWORDS);
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+        filter_avx2(chunk, count, filter, bits);
+    } else {
+        filter_sse2(chunk, count, filter, bits);
+    }
+#else
+    filter_scalar(chunk, 0, count, filter, bits);
+#endif
+}
+
+
+/** Moves the selected cells of one column of a chunk down to an index
+ * @param sys   system structure
+ * @param column   offset of the column in InoculaChunk
+ * @param chunk   index of the chunk read
+ * @param count   records in use in the chunk
+ * @param bits   selection bitmap of the chunk
+ * @param to   index of the first cell written, at most the first read
+ * @details Every cell is written to a buffer and the buffer end advances
+by its bit, so there is no branch on the selection; the buffer is then
+copied in at most two runs. Writing never passes reading, so the column can
+be compacted in place
+ * @return  number of cells selected
+ */
+static int compact_column(Sys *sys, size_t column, int chunk, int count,
+    const unsigned long long *bits, int to) {
+    const int *from = (const int *)((char *)sys->chunks[chunk] + column);
+    int buffer[CHUNKSIZE], selected = 0;
+
+    for (int i = 0; i < count; i++) {
+        buffer[selected] = from[i];
+        selected += (bits[i >> 6] >> (i & 63)) & 1;
+    }
+    for (int done = 0; done < selected; ) { /* up to the end of a chunk */
+        int offset = to & (CHUNKSIZE - 1);
+        int run = CHUNKSIZE - offset < selected - done ?
+            CHUNKSIZE - offset : selected - done;
+        memmove((char *)sys->chunks[to >> CHUNKBITS] + column +
+            sizeof(int) * offset, &buffer[done], sizeof(int) * run);
+        done += run;
+        to += run;
+    }
+    return selected;
+}
+
+
+/** Keeps only the selected records, in order, at the start of the columns
+ * @param sys   system structure
+ * @param filter   predicates of the records kept
+ * @details The links are not moved; the caller rebuilds them
+ * @return  number of records kept
+ */
+int compact_records(Sys *sys, const RecordFilter *filter) {
+    unsigned long long bits[CHUNKWORDS];
+    int kept = 0;
+
+    for (int c = 0; c * CHUNKSIZE < sys->num_inocula; c++) {
+        int count = sys->num_inocula - c * CHUNKSIZE;
+
+        if (count > CHUNKSIZE) {
+            count = CHUNKSIZE;
+        }
+        filter_chunk(sys->chunks[c], count, filter, bits);
+        compact_column(sys, offsetof(InoculaChunk, vacc_id), c, count, bits,
+            kept);
+        compact_column(sys, offsetof(InoculaChunk, batch_id), c, count, bits,
+            kept);
+        compact_column(sys, offsetof(InoculaChunk, ap_date), c, count, bits,
+            kept);
+        kept += compact_column(sys, offsetof(InoculaChunk, user_id), c,
+            count, bits, kept);
+    }
+    return kept;
+}
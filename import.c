@@ -0,0 +1,871 @@
+/**
+ * Vaccination Management System - Bulk Import
+ * @brief: This file loads whole files of batches and past inoculations:
+ * - CSV rows, one per line: batch,dd-mm-yyyy,doses,vaccine for batches
+ *   (the fields of 'c') and user,vaccine,batch,dd-mm-yyyy for inoculations
+ * - The same validations as the commands; rejected rows are counted, not
+ *   printed
+ * - Inoculations are checked, matched against each other and written by a
+ *   pool of threads, in rounds; only deciding each row, in file order, is
+ *   serial. They are sorted by date once at the end (stable radix sort, also
+ *   on the threads), then the user and batch lists are built once
+ * Empty lines and lines starting with '#' are skipped.
+ * @file: import.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "project.h"
+
+/** Starts the summary of an import
+ * @param summary   import summary
+ */
+static void set_summary(ImportSummary *summary) {
+    summary->loaded = 0;
+    summary->rejected = 0;
+    summary->first_line = 0;
+    summary->first_error = ERRNONE;
+}
+
+
+/** Counts a row in the summary of an import
+ * @param summary   import summary
+ * @param error   result of the row
+ * @param number   line of the row
+ */
+static void count_row(ImportSummary *summary, int error, long long number) {
+    if (error == ERRNONE) {
+        summary->loaded++;
+        return;
+    }
+    if (summary->rejected++ == 0) {
+        summary->first_line = number;
+        summary->first_error = error;
+    }
+}
+
+
+/** Returns the next row of an import file
+ * @param in   reader of the file
+ * @param number   line number, advanced past the row
+ * @details Skips empty and comment lines, and drops a '\r' line end
+ * @return  the row, NULL at the end of the file
+ */
+static char *next_row(Reader *in, long long *number) {
+    char *line;
+
+    while ((line = read_line(in)) != NULL) {
+        size_t len = strlen(line);
+
+        (*number)++;
+        if (len > 0 && line[len - 1] == '\r') {
+            line[--len] = '\0';
+        }
+        if (len > 0 && line[0] != '#') {
+            return line;
+        }
+    }
+    return NULL;
+}
+
+
+/** Loads a file of batches
+ * @param sys   system structure
+ * @param path   path of the file
+ * @param summary   receives the outcome
+ * @details Each row goes through add_batch(), so through
+validate_batch_inputs(); there are at most MAXBATCH batches, so there is
+nothing to gain from deferring their indexes
+ * @return  0 if read, 1 if the file cannot be opened
+ */
+int import_batches(Sys *sys, const char *path, ImportSummary *summary) {
+    Reader in;
+    long long number = 0;
+    char *line;
+
+    if (open_input(&in, path, sys->batch_arena.idiom)) {
+        return 1;
+    }
+    set_summary(summary);
+    while ((line = next_row(&in, &number)) != NULL) {
+        char *cursor = line, *batch_name = next_field(&cursor);
+        char *date = next_field(&cursor), *doses = next_field(&cursor);
+        char *vacc_name = next_field(&cursor);
+        Date exp_date = 0;
+        int quantity = 0;
+
+        /* malformed fields are left invalid, to fail their validation */
+        parse_date(date, &exp_date);
+        parse_int(doses, &quantity);
+        count_row(summary, add_batch(sys, batch_name, &exp_date, quantity,
+            vacc_name != NULL ? vacc_name : ""), number);
+    }
+    close_input(&in);
+    return 0;
+}
+
+
+/** Maps the ID of each batch name to its slot
+ * @param sys   system structure
+ * @details A batch with records is never removed, so its name has one slot
+ * @return  slot of every name ID registered so far, NIL if not a batch
+ */
+static int *map_batch_slots(Sys *sys) {
+    int *slot_of = malloc(sizeof(int) * (sys->names.num_names + 1));
+
+    check_allocation(slot_of, sys->record_arena.idiom);
+    for (int i = 0; i < sys->names.num_names; i++) {
+        slot_of[i] = NIL;
+    }
+    for (int i = 0; i < sys->top_batch; i++) {
+        if (sys->batches[i].batch_id != NIL) {
+            slot_of[sys->batches[i].batch_id] = i;
+        }
+    }
+    return slot_of;
+}
+
+
+/* a line of an inoculation file, through the passes of its round */
+typedef struct {
+    char *user_name;        /**< user, split in place in the file */
+    char *vacc_name;        /**< vaccine, split in place in the file */
+    Date date;      /**< application date */
+    int slot;       /**< slot of the batch */
+    int error;      /**< result of the checks on the row alone (NIL if the
+    line is not a row) */
+    unsigned int hash;      /**< hash_name() of the user */
+    int user_id;        /**< ID of the user (NIL until interned) */
+    int vacc_id;        /**< ID of the vaccine (NIL until interned) */
+    int user_first;     /**< first row of the round with the same user */
+    int key_first;      /**< first row of the round with the same dose */
+    int pos;        /**< index of the record (NIL if rejected) */
+    char known;     /**< 1 if the dose was registered before the round */
+    char claimed;       /**< 1 once a row of the same dose is loaded */
+} ImportRow;
+
+
+/* an import of past inoculations, shared by its threads */
+typedef struct {
+    Sys *sys;       /**< system structure */
+    int threads;        /**< threads of each pass */
+    int *slot_of;       /**< slot of each batch name ID */
+    int num_ids;        /**< name IDs mapped by slot_of */
+    char *text;     /**< the file, every line ended by a newline */
+    size_t start[IMPORTTHREADS + 1];        /**< byte range of each thread
+    in the round, cut after a newline */
+    char *tail;     /**< last line of the round when the file does not end
+    with a newline, NULL otherwise */
+    int first[IMPORTTHREADS + 1];       /**< first row of each byte range */
+    ImportRow *rows;        /**< one per line of the round */
+    int num_rows;       /**< lines in the round */
+    int *order;     /**< valid rows, grouped by user partition */
+    int parts[IMPORTTHREADS][IMPORTTHREADS];        /**< rows of each thread
+    in each partition, then where they go in order */
+    int bounds[IMPORTTHREADS + 1];      /**< first entry of each partition in
+    order */
+    int new_slots[IMPORTTHREADS];       /**< dose set slots never used taken
+    by each thread */
+    int *sort_order;        /**< record at each position, by date */
+    int *sort_spare;        /**< scatter target of a pass, then a column */
+    int *counts;        /**< digit counts of each thread, then where its
+    records go */
+    int shift;      /**< digit of the sort pass */
+    size_t column;      /**< offset in InoculaChunk of the column moved */
+} Import;
+
+
+/* a thread of an import */
+typedef struct {
+    Import *import;     /**< the import */
+    int index;      /**< 0 for the calling thread */
+} ImportWorker;
+
+
+/** Runs a pass of an import on every thread and waits for them
+ * @param import   the import
+ * @param work   the pass, given its ImportWorker
+ * @details The calling thread is the first worker; a worker whose thread
+cannot be started runs on the calling thread once the others are done
+ */
+static void run_workers(Import *import, void *(*work)(void *)) {
+    pthread_t thread[IMPORTTHREADS];
+    ImportWorker worker[IMPORTTHREADS];
+    int started = 1;
+
+    for (int w = 0; w < import->threads; w++) {
+        worker[w].import = import;
+        worker[w].index = w;
+    }
+    while (started < import->threads && pthread_create(&thread[started],
+        NULL, work, &worker[started]) == 0) {
+        started++;
+    }
+    work(&worker[0]);
+    for (int w = 1; w < started; w++) {
+        pthread_join(thread[w], NULL);
+    }
+    for (int w = started; w < import->threads; w++) {
+        work(&worker[w]);
+    }
+}
+
+
+/** Returns the share of a thread of n items
+ * @param worker   the thread
+ * @param n   number of items
+ * @param lo   receives the first item
+ * @param hi   receives the item after the last
+ */
+static void worker_range(const ImportWorker *worker, int n, int *lo,
+    int *hi) {
+    int threads = worker->import->threads;
+
+    *lo = (int)((long long)n * worker->index / threads);
+    *hi = (int)((long long)n * (worker->index + 1) / threads);
+}
+
+
+/** Validates a row of past inoculation on its own
+ * @param sys   system structure
+ * @param line   the row, split in place
+ * @param slot_of   slot of each batch name ID
+ * @param num_ids   name IDs mapped by slot_of
+ * @param row   receives the fields
+ * @details The dose comes from the batch given, which must be of the
+vaccine given (any case); the date must be valid and not in the future.
+Whether the user already had the dose and the batch can still give it
+(doses left, not expired on that day) is left to load_rows()
+ * @return  ERRNONE, ERRINVNAME, ERRINVDATE, ERRNOSBATCH or ERRNOSVACC
+ */
+static int check_record(Sys *sys, char *line, const int *slot_of,
+    int num_ids, ImportRow *row) {
+    char *cursor = line, *batch_name, *date;
+    int batch_id;
+    Batch *batch;
+
+    row->user_name = next_field(&cursor);
+    row->vacc_name = next_field(&cursor);
+    batch_name = next_field(&cursor);
+    date = next_field(&cursor);
+    if (row->vacc_name == NULL || *row->user_name == '\0' ||
+        validate_vacc_name(row->vacc_name)) {
+        return ERRINVNAME;
+    }
+    if (batch_name == NULL || parse_date(date, &row->date) ||
+        validate_calendar(&row->date) || is_future_date(&row->date, sys)) {
+        return ERRINVDATE;
+    }
+    batch_id = find_name(&sys->names, batch_name);
+    if (batch_id == NIL || batch_id >= num_ids || slot_of[batch_id] == NIL) {
+        return ERRNOSBATCH;
+    }
+    batch = &sys->batches[slot_of[batch_id]];
+    if (strcasecmp(row->vacc_name, name_of(&sys->names, batch->vacc_id))
+        != 0) {
+        return ERRNOSVACC;
+    }
+    row->slot = slot_of[batch_id];
+    row->hash = hash_name(row->user_name);
+    return ERRNONE;
+}
+
+
+/** Reads a line of an inoculation file into its row
+ * @param import   the import
+ * @param line   the line, without its newline
+ * @param row   receives the row
+ * @details Empty and comment lines are not rows, and a '\r' line end is
+dropped
+ */
+static void check_line(Import *import, char *line, ImportRow *row) {
+    size_t len = strlen(line);
+
+    if (len > 0 && line[len - 1] == '\r') {
+        line[--len] = '\0';
+    }
+    row->pos = NIL;
+    row->known = row->claimed = 0;
+    row->error = len > 0 && line[0] != '#' ? check_record(import->sys, line,
+        import->slot_of, import->num_ids, row) : NIL;
+}
+
+
+/** Counts the lines of a thread's byte range
+ * @param arg   the thread (ImportWorker)
+ * @return  NULL
+ */
+static void *count_lines(void *arg) {
+    ImportWorker *worker = arg;
+    Import *import = worker->import;
+    char *p = import->text + import->start[worker->index];
+    char *end = import->text + import->start[worker->index + 1];
+    int lines = 0;
+
+    while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+        lines++;
+        p++;
+    }
+    import->first[worker->index + 1] = lines;
+    return NULL;
+}
+
+
+/** Checks the rows of a thread's byte range and counts them by partition
+ * @param arg   the thread (ImportWorker)
+ * @details The last thread also takes the line without a newline, if any.
+A user's partition is its hash modulo the threads
+ * @return  NULL
+ */
+static void *check_rows(void *arg) {
+    ImportWorker *worker = arg;
+    Import *import = worker->import;
+    int w = worker->index, r = import->first[w];
+    char *p = import->text + import->start[w];
+    char *end = import->text + import->start[w + 1];
+
+    while (p < end) {
+        char *newline = memchr(p, '\n', end - p);
+        *newline = '\0';
+        check_line(import, p, &import->rows[r++]);
+        p = newline + 1;
+    }
+    if (w == import->threads - 1 && import->tail != NULL) {
+        check_line(import, import->tail, &import->rows[r++]);
+    }
+    memset(import->parts[w], 0, sizeof(import->parts[w]));
+    for (int i = import->first[w]; i < r; i++) {
+        if (import->rows[i].error == ERRNONE) {
+            import->parts[w][import->rows[i].hash % import->threads]++;
+        }
+    }
+    return NULL;
+}
+
+
+/** Lists the valid rows of a thread's byte range under their partitions
+ * @param arg   the thread (ImportWorker)
+ * @return  NULL
+ */
+static void *group_rows(void *arg) {
+    ImportWorker *worker = arg;
+    Import *import = worker->import;
+    int w = worker->index;
+    int end = w == import->threads - 1 ? import->num_rows :
+        import->first[w + 1];
+
+    for (int i = import->first[w]; i < end; i++) {
+        if (import->rows[i].error == ERRNONE) {
+            import->order[import->parts[w][import->rows[i].hash %
+                import->threads]++] = i;
+        }
+    }
+    return NULL;
+}
+
+
+/** Finds the rows of each user and of each dose in a partition
+ * @param arg   the thread (ImportWorker), the index of its partition
+ * @details All the rows of a user are in its partition, in file order, so
+the first row of each user and of each (user, vaccine, date) is found
+without sharing anything. The names and doses registered before the round
+are looked up, not added
+ * @return  NULL
+ */
+static void *find_doses(void *arg) {
+    ImportWorker *worker = arg;
+    Import *import = worker->import;
+    Sys *sys = import->sys;
+    ImportRow *rows = import->rows;
+    int lo = import->bounds[worker->index];
+    int hi = import->bounds[worker->index + 1];
+    int size = 16, mask, *users, *keys;
+
+    while (size < 2 * (hi - lo)) {
+        size *= 2;
+    }
+    mask = size - 1;
+    users = malloc(sizeof(int) * size);
+    keys = malloc(sizeof(int) * size);
+    check_allocation(users, sys->record_arena.idiom);
+    check_allocation(keys, sys->record_arena.idiom);
+    memset(users, 0xFF, sizeof(int) * size); /* all NIL */
+    memset(keys, 0xFF, sizeof(int) * size);
+    for (int i = lo; i < hi; i++) {
+        int r = import->order[i];
+        ImportRow *row = &rows[r];
+        /* the low bits of the hash are the partition's */
+        int pos = (row->hash / import->threads) & mask;
+        unsigned int key;
+
+        while (users[pos] != NIL && (rows[users[pos]].hash != row->hash ||
+            strcmp(rows[users[pos]].user_name, row->user_name) != 0)) {
+            pos = (pos + 1) & mask;
+        }
+        if (users[pos] == NIL) {
+            users[pos] = r;
+            row->user_id = find_name(&sys->names, row->user_name);
+        } else {
+            row->user_id = rows[users[pos]].user_id;
+        }
+        row->user_first = users[pos];
+        row->vacc_id = find_name(&sys->names, row->vacc_name);
+        row->known = row->user_id != NIL && row->vacc_id != NIL &&
+            has_dose_key(sys, row->user_id, row->vacc_id, &row->date);
+
+        key = (unsigned int)row->user_first * 0x9E3779B1u ^
+            row->date * 0x85EBCA6Bu;
+        pos = (key ^ key >> 16) & mask;
+        while (keys[pos] != NIL &&
+            (rows[keys[pos]].user_first != row->user_first ||
+            rows[keys[pos]].date != row->date ||
+            strcmp(rows[keys[pos]].vacc_name, row->vacc_name) != 0)) {
+            pos = (pos + 1) & mask;
+        }
+        if (keys[pos] == NIL) {
+            keys[pos] = r;
+        }
+        row->key_first = keys[pos];
+    }
+    free(users);
+    free(keys);
+    return NULL;
+}
+
+
+/** Writes the records and dose keys of a thread's share of the rows
+ * @param arg   the thread (ImportWorker)
+ * @details Room for them was reserved, and each has its own index
+ * @return  NULL
+ */
+static void *store_rows(void *arg) {
+    ImportWorker *worker = arg;
+    Import *import = worker->import;
+    Sys *sys = import->sys;
+    int lo, hi, new_slots = 0;
+
+    worker_range(worker, import->num_rows, &lo, &hi);
+    for (int i = lo; i < hi; i++) {
+        ImportRow *row = &import->rows[i];
+        Inocula record;
+        DoseKey key;
+
+        if (row->pos == NIL) {
+            continue;
+        }
+        record.user_id = key.user_id = row->user_id;
+        record.vacc_id = key.vacc_id = row->vacc_id;
+        record.ap_date = key.date = row->date;
+        record.batch_id = sys->batches[row->slot].batch_id;
+        record.next = record.batch_next = NIL;
+        store_inocula(sys, row->pos, &record);
+        new_slots += add_shared_dose_key(sys, &key);
+    }
+    import->new_slots[worker->index] = new_slots;
+    return NULL;
+}
+
+
+/** Decides the rows of a round in file order and loads the valid ones
+ * @param import   the import
+ * @param left   doses each batch slot has left, counted down
+ * @param line   line number before the round
+ * @param summary   import summary
+ * @param last   date of the last record loaded, updated
+ * @param sorted   cleared if a record is older than the one before it
+ * @details The checks left run in the order of administer(): a dose the
+user already had is ERRALRVACC, then a batch expired on that day or with no
+doses left is ERRNOSTOCK. A dose is only loaded by the first row of it that
+passes, as it would be one row at a time. Only the names of rows loaded are
+interned, in file order, so the IDs are those of a serial load
+ */
+static void load_rows(Import *import, int *left, long long line,
+    ImportSummary *summary, Date *last, int *sorted) {
+    Sys *sys = import->sys;
+    int loaded = 0, new_slots = 0;
+
+    for (int i = 0; i < import->num_rows; i++) {
+        ImportRow *row = &import->rows[i], *user;
+        int error = row->error;
+
+        if (error == NIL) {
+            continue;
+        }
+        if (error == ERRNONE &&
+            (row->known || import->rows[row->key_first].claimed)) {
+            error = ERRALRVACC;
+        } else if (error == ERRNONE && (left[row->slot] == 0 ||
+            row->date > sys->batches[row->slot].exp_date)) {
+            error = ERRNOSTOCK;
+        } else if (error == ERRNONE) {
+            import->rows[row->key_first].claimed = 1;
+            left[row->slot]--;
+            row->pos = sys->num_inocula + loaded++;
+            user = &import->rows[row->user_first];
+            if (user->user_id == NIL) {
+                user->user_id = intern(&sys->names, user->user_name);
+            }
+            row->user_id = user->user_id;
+            if (row->vacc_id == NIL) {
+                row->vacc_id = intern(&sys->names, row->vacc_name);
+            }
+            *sorted &= row->date >= *last;
+            *last = row->date;
+        }
+        count_row(summary, error, line + i + 1);
+    }
+
+    reserve_inocula(sys, loaded);
+    reserve_dose_keys(sys, loaded);
+    run_workers(import, store_rows);
+    for (int w = 0; w < import->threads; w++) {
+        new_slots += import->new_slots[w];
+    }
+    sys->num_inocula += loaded;
+    sys->dose_set_live += loaded;
+    sys->dose_set_used += new_slots;
+    for (int i = 0; i < sys->top_batch; i++) {
+        if (sys->batches[i].batch_id != NIL &&
+            left[i] != sys->batches[i].doses) {
+            claim_stock(sys, i, left[i]);
+        }
+    }
+}
+
+
+/** Runs one round of an import: its rows are in the byte ranges set
+ * @param import   the import
+ * @param line   line number before the round
+ * @param summary   import summary
+ * @param last   date of the last record loaded, updated
+ * @param sorted   cleared if a record is older than the one before it
+ * @return  lines in the round
+ */
+static int import_round(Import *import, long long line,
+    ImportSummary *summary, Date *last, int *sorted) {
+    Sys *sys = import->sys;
+    int total = 0, *left;
+
+    run_workers(import, count_lines);
+    import->first[0] = 0;
+    for (int w = 0; w < import->threads; w++) {
+        import->first[w + 1] += import->first[w];
+    }
+    import->num_rows = import->first[import->threads] +
+        (import->tail != NULL);
+    import->rows = malloc(sizeof(ImportRow) * (import->num_rows + 1));
+    import->order = malloc(sizeof(int) * (import->num_rows + 1));
+    check_allocation(import->rows, sys->record_arena.idiom);
+    check_allocation(import->order, sys->record_arena.idiom);
+
+    run_workers(import, check_rows);
+    for (int p = 0; p < import->threads; p++) {
+        import->bounds[p] = total;
+        for (int w = 0; w < import->threads; w++) {
+            int count = import->parts[w][p];
+            import->parts[w][p] = total;
+            total += count;
+        }
+    }
+    import->bounds[import->threads] = total;
+    run_workers(import, group_rows);
+    run_workers(import, find_doses);
+
+    left = malloc(sizeof(int) * (sys->top_batch + 1));
+    check_allocation(left, sys->record_arena.idiom);
+    for (int i = 0; i < sys->top_batch; i++) {
+        left[i] = sys->batches[i].doses;
+    }
+    load_rows(import, left, line, summary, last, sorted);
+    free(left);
+    free(import->rows);
+    free(import->order);
+    return import->num_rows;
+}
+
+
+/** Counts the dates of a thread's share of the records, by digit
+ * @param arg   the thread (ImportWorker)
+ * @return  NULL
+ */
+static void *count_dates(void *arg) {
+    ImportWorker *worker = arg;
+    Import *import = worker->import;
+    Sys *sys = import->sys;
+    int *counts = import->counts + ((size_t)worker->index << 16), lo, hi;
+
+    worker_range(worker, sys->num_inocula, &lo, &hi);
+    memset(counts, 0, sizeof(int) << 16);
+    for (int i = lo; i < hi; i++) {
+        counts[INOCULA(sys, import->sort_order[i], ap_date) >>
+            import->shift & 0xFFFF]++;
+    }
+    return NULL;
+}
+
+
+/** Moves a thread's share of the records to their place by digit
+ * @param arg   the thread (ImportWorker)
+ * @details Stable: each thread's records of a digit go after those of the
+threads before it, in order
+ * @return  NULL
+ */
+static void *scatter_dates(void *arg) {
+    ImportWorker *worker = arg;
+    Import *import = worker->import;
+    Sys *sys = import->sys;
+    int *counts = import->counts + ((size_t)worker->index << 16), lo, hi;
+
+    worker_range(worker, sys->num_inocula, &lo, &hi);
+    for (int i = lo; i < hi; i++) {
+        int from = import->sort_order[i];
+        import->sort_spare[counts[INOCULA(sys, from, ap_date) >>
+            import->shift & 0xFFFF]++] = from;
+    }
+    return NULL;
+}
+
+
+/** Reads a thread's share of a column in date order
+ * @param arg   the thread (ImportWorker)
+ * @return  NULL
+ */
+static void *gather_column(void *arg) {
+    ImportWorker *worker = arg;
+    Import *import = worker->import;
+    Sys *sys = import->sys;
+    int lo, hi;
+
+    worker_range(worker, sys->num_inocula, &lo, &hi);
+    for (int i = lo; i < hi; i++) {
+        int from = import->sort_order[i];
+        import->sort_spare[i] = ((int *)((char *)sys->chunks[from >>
+            CHUNKBITS] + import->column))[from & (CHUNKSIZE - 1)];
+    }
+    return NULL;
+}
+
+
+/** Writes back a thread's share of a column read by gather_column()
+ * @param arg   the thread (ImportWorker)
+ * @return  NULL
+ */
+static void *scatter_column(void *arg) {
+    ImportWorker *worker = arg;
+    Import *import = worker->import;
+    Sys *sys = import->sys;
+    int lo, hi;
+
+    worker_range(worker, sys->num_inocula, &lo, &hi);
+    for (int i = lo; i < hi; i++) {
+        ((int *)((char *)sys->chunks[i >> CHUNKBITS] +
+            import->column))[i & (CHUNKSIZE - 1)] = import->sort_spare[i];
+    }
+    return NULL;
+}
+
+
+/** Sorts the records by date, keeping the order of each day's records
+ * @param import   the import
+ * @details Least significant digit radix sort of the dates, 16 bits per
+pass: O(n), where inserting each record in place would move the ones
+after it. Each pass counts and moves the threads' shares at once; the
+columns are then moved one at a time, every thread taking a share. The
+links are not moved; the caller rebuilds them
+ */
+static void sort_by_date(Import *import) {
+    Sys *sys = import->sys;
+    int n = sys->num_inocula, threads = import->threads;
+    static const size_t columns[] = {
+        offsetof(InoculaChunk, user_id), offsetof(InoculaChunk, vacc_id),
+        offsetof(InoculaChunk, batch_id), offsetof(InoculaChunk, ap_date)
+    };
+
+    import->sort_order = malloc(sizeof(int) * n);
+    import->sort_spare = malloc(sizeof(int) * n);
+    import->counts = malloc((sizeof(int) * threads) << 16);
+    check_allocation(import->sort_order, sys->record_arena.idiom);
+    check_allocation(import->sort_spare, sys->record_arena.idiom);
+    check_allocation(import->counts, sys->record_arena.idiom);
+    for (int i = 0; i < n; i++) {
+        import->sort_order[i] = i;
+    }
+    for (import->shift = 0; import->shift < 32; import->shift += 16) {
+        int total = 0, *swap;
+
+        run_workers(import, count_dates);
+        for (int d = 0; d < 1 << 16; d++) {
+            for (int w = 0; w < threads; w++) {
+                int count = import->counts[((size_t)w << 16) + d];
+                import->counts[((size_t)w << 16) + d] = total;
+                total += count;
+            }
+        }
+        run_workers(import, scatter_dates);
+        swap = import->sort_order;
+        import->sort_order = import->sort_spare;
+        import->sort_spare = swap;
+    }
+    for (size_t c = 0; c < sizeof(columns) / sizeof(columns[0]); c++) {
+        import->column = columns[c];
+        run_workers(import, gather_column);
+        run_workers(import, scatter_column);
+    }
+    free(import->sort_order);
+    free(import->sort_spare);
+    free(import->counts);
+}
+
+
+/** Returns the whole of an import file, every line ended by a newline
+ * @param in   reader of the file
+ * @param len   receives the bytes up to the last newline
+ * @param tail   receives a copy of the last line if it has no newline,
+NULL otherwise
+ * @details A mapped file is used in place; any other is read into memory
+ * @return  the text, to release with release_text()
+ */
+static char *read_text(Reader *in, size_t *len, char **tail) {
+    char *text, *line;
+    size_t cap = INBLOCK;
+
+    *tail = NULL;
+    if (in->mapped) {
+        *len = in->len;
+        if (*len > 0 && in->buf[*len - 1] != '\n') {
+            size_t start = *len - 1;
+
+            while (start > 0 && in->buf[start - 1] != '\n') {
+                start--;
+            }
+            *tail = malloc(*len - start + 1);
+            check_allocation(*tail, in->idiom);
+            memcpy(*tail, in->buf + start, *len - start);
+            (*tail)[*len - start] = '\0';
+            *len = start;
+        }
+        return in->buf;
+    }
+    text = malloc(cap);
+    check_allocation(text, in->idiom);
+    *len = 0;
+    while ((line = read_line(in)) != NULL) {
+        size_t size = strlen(line);
+
+        while (*len + size + 1 > cap) {
+            cap *= 2;
+            text = realloc(text, cap);
+            check_allocation(text, in->idiom);
+        }
+        memcpy(text + *len, line, size);
+        text[*len + size] = '\n';
+        *len += size + 1;
+    }
+    return text;
+}
+
+
+/** Releases the text returned by read_text()
+ * @param in   reader of the file
+ * @param text   the text
+ * @param tail   the copy of the last line, if any
+ */
+static void release_text(Reader *in, char *text, char *tail) {
+    if (!in->mapped) {
+        free(text);
+    }
+    free(tail);
+}
+
+
+/** Cuts a round of an import file in a byte range per thread
+ * @param import   the import
+ * @param from   first byte of the round
+ * @param to   byte after the round, after a newline
+ * @details Each range starts after a newline, and can be empty
+ */
+static void split_round(Import *import, size_t from, size_t to) {
+    import->start[0] = from;
+    for (int w = 1; w < import->threads; w++) {
+        size_t cut = from + (to - from) * w / import->threads;
+        char *newline;
+
+        if (cut < import->start[w - 1]) {
+            cut = import->start[w - 1];
+        }
+        newline = cut < to ? memchr(import->text + cut, '\n', to - cut) :
+            NULL;
+        import->start[w] = newline != NULL ?
+            (size_t)(newline - import->text) + 1 : to;
+    }
+    import->start[import->threads] = to;
+}
+
+
+/** Loads a file of past inoculations
+ * @param sys   system structure
+ * @param path   path of the file
+ * @param threads   threads to use, 0 for one per CPU
+ * @param summary   receives the outcome
+ * @details The file is read in rounds of IMPORTBLOCK bytes per thread.
+In each round, the threads check their share of the lines on their own
+(see check_record()), then each looks for the repeated users and doses of
+one partition of the users. The rows are then decided and their names
+interned in file order, as a load of one row at a time would, and the
+threads write the records and their dose keys at once. Once the file is
+read, the records are sorted by date only if the file was not already in
+order, and the user and batch lists are rebuilt in one pass
+ * @return  0 if read, 1 if the file cannot be opened
+ */
+int import_records(Sys *sys, const char *path, int threads,
+    ImportSummary *summary) {
+    Reader in;
+    Import import;
+    long long line = 0;
+    size_t len, done = 0;
+    int sorted = 1;
+    Date last = sys->num_inocula > 0 ?
+        INOCULA(sys, sys->num_inocula - 1, ap_date) : 0;
+    char *tail;
+
+    if (open_input(&in, path, sys->record_arena.idiom)) {
+        return 1;
+    }
+    if (threads < 1) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+    import.sys = sys;
+    import.threads = threads < IMPORTTHREADS ? threads : IMPORTTHREADS;
+    import.slot_of = map_batch_slots(sys);
+    import.num_ids = sys->names.num_names;
+    import.text = read_text(&in, &len, &tail);
+    set_summary(summary);
+    do {
+        size_t round = (size_t)import.threads * IMPORTBLOCK, to = len;
+
+        if (len - done > round) { /* up to the end of a line */
+            to = (char *)memchr(import.text + done + round - 1, '\n',
+                len - done - round + 1) - import.text + 1;
+        }
+        split_round(&import, done, to);
+        import.tail = to == len ? tail : NULL;
+        line += import_round(&import, line, summary, &last, &sorted);
+        done = to;
+    } while (done < len);
+    free(import.slot_of);
+    release_text(&in, import.text, tail);
+    close_input(&in);
+    if (summary->loaded > 0) {
+        if (!sorted) {
+            sort_by_date(&import);
+        }
+        rebuild_user_index(sys);
+        rebuild_batch_index(sys);
+    }
+    return 0;
+}
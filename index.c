@@ -0,0 +1,371 @@
+/**
+ * Vaccination Management System - Inoculation Indexes
+ * @brief: This file contains the hash indexes over inoculation records:
+ * - Dose set: open-addressing set of (user, vaccine, date) keys used by
+ *   is_already_vaccinated()
+ * - User index: the linked list of each user's records in date order,
+ *   found through the ID of the user's name
+ * - Batch index: the linked list of the records from each batch in date
+ *   order, held by its batch slot
+ * - Compaction of deleted records
+ * @file: index.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "project.h"
+
+/** marks a dose set slot whose key was removed */
+#define REMOVED -2
+
+
+/** Hashes a (user, vaccine, date) key
+ * @param user_id   ID of name of the user
+ * @param vacc_id   ID of name of the vaccine
+ * @param date   application date
+ * @return  hash value
+ */
+static unsigned int hash_dose_key(int user_id, int vacc_id, Date *date) {
+    unsigned int hash = user_id * 0x9e3779b1u;
+
+    hash = (hash ^ vacc_id) * 0x85ebca6bu;
+    hash = (hash ^ *date) * 0xc2b2ae35u;
+    /* spread the bits before masking */
+    return hash ^ (hash >> 16);
+}
+
+
+/** Finds the dose set slot of a key
+ * @param sys   system structure
+ * @param user_id   ID of name of the user
+ * @param vacc_id   ID of name of the vaccine
+ * @param date   application date
+ * @return  slot holding the key, or NIL if it is not in the set
+ */
+static int find_dose_slot(Sys *sys, int user_id, int vacc_id, Date *date) {
+    int mask = sys->dose_set_size - 1;
+    int pos;
+
+    if (sys->dose_set_size == 0) {
+        return NIL;
+    }
+    pos = hash_dose_key(user_id, vacc_id, date) & mask;
+
+    /* linear probing until an empty slot */
+    while (sys->dose_set[pos].user_id != NIL) {
+        DoseKey *key = &sys->dose_set[pos];
+        if (key->user_id == user_id && key->vacc_id == vacc_id &&
+            key->date == *date) {
+            return pos;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return NIL;
+}
+
+
+/** Stores a key in the first free slot of its probe sequence
+ * @param sys   system structure
+ * @param key   key to store (not yet in the set)
+ */
+static void place_dose_key(Sys *sys, DoseKey *key) {
+    int mask = sys->dose_set_size - 1;
+    int pos = hash_dose_key(key->user_id, key->vacc_id, &key->date) & mask;
+
+    while (sys->dose_set[pos].user_id != NIL &&
+        sys->dose_set[pos].user_id != REMOVED) {
+        pos = (pos + 1) & mask;
+    }
+    if (sys->dose_set[pos].user_id == NIL) {
+        sys->dose_set_used++; /* reusing a removed slot costs nothing */
+    }
+    sys->dose_set[pos] = *key;
+}
+
+
+/** Rebuilds the dose set, dropping removed slots and growing if needed
+ * @param sys   system structure
+ * @param extra   keys about to be added
+ * @details A rehash that keeps the size swaps the table with a spare one,
+so repeated clean-ups do not keep taking arena memory
+ */
+static void rehash_dose_set(Sys *sys, int extra) {
+    DoseKey *old = sys->dose_set;
+    int old_size = sys->dose_set_size;
+
+    /* keep the live keys at most a quarter of the table after rehash */
+    if (sys->dose_set_size == 0) {
+        sys->dose_set_size = 64;
+    }
+    while (4 * ((long long)sys->dose_set_live + extra + 1) >
+        sys->dose_set_size) {
+        sys->dose_set_size *= 2;
+    }
+    if (sys->dose_set_size == old_size && sys->dose_spare != NULL) {
+        sys->dose_set = sys->dose_spare;
+    } else {
+        sys->dose_set = arena_alloc(&sys->record_arena,
+            sizeof(DoseKey) * sys->dose_set_size);
+    }
+    sys->dose_spare = sys->dose_set_size == old_size ? old : NULL;
+    sys->dose_set_used = 0;
+
+    for (int i = 0; i < sys->dose_set_size; i++) {
+        sys->dose_set[i].user_id = NIL;
+    }
+    for (int i = 0; i < old_size; i++) {
+        if (old[i].user_id != NIL && old[i].user_id != REMOVED) {
+            place_dose_key(sys, &old[i]);
+        }
+    }
+}
+
+
+/** Checks if a (user, vaccine, date) key is in the dose set
+ * @param sys   system structure
+ * @param user_id   ID of name of the user
+ * @param vacc_id   ID of name of the vaccine
+ * @param date   application date
+ * @return  1 if present, 0 otherwise
+ */
+int has_dose_key(Sys *sys, int user_id, int vacc_id, Date *date) {
+    return find_dose_slot(sys, user_id, vacc_id, date) != NIL;
+}
+
+
+/** Adds the key of a new inoculation to the dose set
+ * @param sys   system structure
+ * @param inocula   inoculation record
+ */
+void add_dose_key(Sys *sys, Inocula *inocula) {
+    DoseKey key;
+
+    /* keep the table at most half full, counting removed slots */
+    if (2 * (sys->dose_set_used + 1) > sys->dose_set_size) {
+        rehash_dose_set(sys, 0);
+    }
+    key.user_id = inocula->user_id;
+    key.vacc_id = inocula->vacc_id;
+    key.date = inocula->ap_date;
+    place_dose_key(sys, &key);
+    sys->dose_set_live++;
+}
+
+
+/** Makes room in the dose set for many keys at once
+ * @param sys   system structure
+ * @param count   keys about to be added by add_shared_dose_key()
+ */
+void reserve_dose_keys(Sys *sys, int count) {
+    if (2 * ((long long)sys->dose_set_used + count) > sys->dose_set_size) {
+        rehash_dose_set(sys, count);
+    }
+}
+
+
+/** Adds a key to the dose set, from one of many threads at once
+ * @param sys   system structure
+ * @param key   key, known not to be in the set
+ * @details Only while every thread adds keys reserved by
+reserve_dose_keys() and none looks keys up. A slot is taken with a
+compare-and-swap of its user, so each goes to a single thread; the other
+fields are only read once the threads are joined. The caller adds the keys
+to dose_set_live and the slots taken to dose_set_used
+ * @return  1 if it took a slot never used, 0 if a removed one
+ */
+int add_shared_dose_key(Sys *sys, const DoseKey *key) {
+    int mask = sys->dose_set_size - 1;
+    int pos = hash_dose_key(key->user_id, key->vacc_id,
+        (Date *)&key->date) & mask;
+
+    for (;; pos = (pos + 1) & mask) {
+        int user = __atomic_load_n(&sys->dose_set[pos].user_id,
+            __ATOMIC_RELAXED);
+        if ((user == NIL || user == REMOVED) &&
+            __atomic_compare_exchange_n(&sys->dose_set[pos].user_id, &user,
+            key->user_id, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            sys->dose_set[pos].vacc_id = key->vacc_id;
+            sys->dose_set[pos].date = key->date;
+            return user == NIL;
+        }
+    }
+}
+
+
+/** Removes the key of a deleted inoculation from the dose set
+ * @param sys   system structure
+ * @param inocula   inoculation record, before it is released
+ */
+void remove_dose_key(Sys *sys, Inocula *inocula) {
+    int pos = find_dose_slot(sys, inocula->user_id, inocula->vacc_id,
+        &inocula->ap_date);
+
+    if (pos != NIL) {
+        sys->dose_set[pos].user_id = REMOVED;
+        sys->dose_set_live--;
+    }
+}
+
+
+/** Looks up a user
+ * @param sys   system structure
+ * @param user_name   name of the user
+ * @return  index of the user (the ID of its name), NIL if it never had
+records
+ */
+int find_user(Sys *sys, const char *user_name) {
+    int user_id = find_name(&sys->names, user_name);
+
+    if (user_id == NIL || user_id >= sys->user_capacity) {
+        return NIL;
+    }
+    return user_id;
+}
+
+
+/** Makes room in the user array for every interned name
+ * @param sys   system structure
+ */
+static void grow_users(Sys *sys) {
+    int old = sys->user_capacity;
+
+    while (sys->user_capacity < sys->names.num_names) {
+        sys->user_capacity = sys->user_capacity ? sys->user_capacity * 2 : 64;
+    }
+    sys->users = arena_grow(&sys->record_arena, sys->users,
+        sizeof(User) * old, sizeof(User) * sys->user_capacity);
+    for (int i = old; i < sys->user_capacity; i++) {
+        sys->users[i].head = sys->users[i].tail = NIL;
+        sys->users[i].count = 0;
+    }
+}
+
+
+/** Appends a record to the list of its user
+ * @param sys   system structure
+ * @param pos   index of the record, later than every record of the user
+ */
+void link_user_record(Sys *sys, int pos) {
+    int user = INOCULA(sys, pos, user_id);
+    User *entry;
+
+    if (user >= sys->user_capacity) {
+        grow_users(sys);
+    }
+    entry = &sys->users[user];
+
+    INOCULA(sys, pos, next) = NIL;
+    if (entry->tail == NIL) {
+        entry->head = pos;
+    } else {
+        INOCULA(sys, entry->tail, next) = pos;
+    }
+    entry->tail = pos;
+    entry->count++;
+}
+
+
+/** Removes a record from the list of its user
+ * @param sys   system structure
+ * @param user   index of the user
+ * @param prev   previous record in the list (NIL if pos is the head)
+ * @param pos   index of the record
+ */
+void unlink_user_record(Sys *sys, int user, int prev, int pos) {
+    User *entry = &sys->users[user];
+    int next = INOCULA(sys, pos, next);
+
+    if (prev == NIL) {
+        entry->head = next;
+    } else {
+        INOCULA(sys, prev, next) = next;
+    }
+    if (entry->tail == pos) {
+        entry->tail = prev;
+    }
+    entry->count--;
+}
+
+
+/** Rebuilds every user list from the records array
+ * @param sys   system structure
+ * @details Needed whenever records change position
+ */
+void rebuild_user_index(Sys *sys) {
+    for (int i = 0; i < sys->user_capacity; i++) {
+        sys->users[i].head = sys->users[i].tail = NIL;
+        sys->users[i].count = 0;
+    }
+    for (int i = 0; i < sys->num_inocula; i++) {
+        if (INOCULA(sys, i, user_id) != NIL) { /* skip deleted records */
+            link_user_record(sys, i);
+        }
+    }
+}
+
+
+/** Appends a record to the list of its batch
+ * @param sys   system structure
+ * @param pos   index of the record, later than every record of the batch
+ * @param slot   slot of the batch the dose came from
+ */
+void link_batch_record(Sys *sys, int pos, int slot) {
+    Batch *batch = &sys->batches[slot];
+
+    INOCULA(sys, pos, batch_next) = NIL;
+    if (batch->rec_tail == NIL) {
+        batch->rec_head = pos;
+    } else {
+        INOCULA(sys, batch->rec_tail, batch_next) = pos;
+    }
+    batch->rec_tail = pos;
+}
+
+
+/** Rebuilds every batch list from the records array
+ * @param sys   system structure
+ * @details Needed whenever records change position. Deleted records are
+only dropped here: until then they stay linked, marked by their NIL user
+ */
+void rebuild_batch_index(Sys *sys) {
+    int *slot_of = malloc(sizeof(int) * (sys->names.num_names + 1));
+
+    check_allocation(slot_of, sys->record_arena.idiom);
+    for (int i = 0; i < sys->names.num_names; i++) {
+        slot_of[i] = NIL;
+    }
+    /* a batch with records is never removed, so its name has one slot */
+    for (int i = 0; i < sys->top_batch; i++) {
+        sys->batches[i].rec_head = sys->batches[i].rec_tail = NIL;
+        if (sys->batches[i].batch_id != NIL) {
+            slot_of[sys->batches[i].batch_id] = i;
+        }
+    }
+    for (int i = 0; i < sys->num_inocula; i++) {
+        if (INOCULA(sys, i, user_id) != NIL) { /* skip deleted records */
+            link_batch_record(sys, i, slot_of[INOCULA(sys, i, batch_id)]);
+        }
+    }
+    free(slot_of);
+}
+
+
+/** Drops deleted records from the array once they are the majority
+ * @param sys   system structure
+ * @details Amortized O(1) per deleted record, as it runs at most once
+every num_inocula / 2 deletions. The live records are selected and moved
+by compact_records(); the user and batch lists are rebuilt after
+ */
+void compact_inoculas(Sys *sys) {
+    RecordFilter live = {NIL, NIL, 0, NIL};
+
+    if (sys->num_dead < MINCOMPACT || 2 * sys->num_dead < sys->num_inocula) {
+        return;
+    }
+    sys->num_inocula = compact_records(sys, &live);
+    sys->num_dead = 0;
+    rebuild_user_index(sys);
+    rebuild_batch_index(sys);
+}
@@ -0,0 +1,170 @@
+/**
+ * Vaccination Management System - Name Interning
+ * @brief: This file contains the intern table shared by user, vaccine and
+ * batch names:
+ * - Every distinct name is stored once and gets a stable integer ID
+ * - Lookup by name through an open-addressing hash table of IDs
+ * @file: intern.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "project.h"
+
+/** Hashes a name (djb2)
+ * @param name   name to hash
+ * @return  hash value
+ */
+unsigned int hash_name(const char *name) {
+    unsigned int hash = 5381;
+
+    for (; *name != '\0'; name++) {
+        hash = hash * 33 + (unsigned char)*name;
+    }
+    return hash;
+}
+
+
+/** Finds the table position of a name
+ * @param names   intern table
+ * @param name   name to look for
+ * @param hash   hash_name() of name
+ * @return  position holding the name's ID, or the empty position where it
+would be inserted
+ */
+static int name_position(Names *names, const char *name, unsigned int hash) {
+    int mask = names->table_size - 1;
+    int pos = hash & mask;
+
+    /* linear probing, comparing hashes before strings */
+    while (names->table[pos] != NIL) {
+        int id = names->table[pos];
+        if (names->hash[id] == hash &&
+            strcmp(names->pool + names->offset[id], name) == 0) {
+            break;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+
+/** Doubles the hash table and reinserts every ID
+ * @param names   intern table
+ */
+static void grow_name_table(Names *names) {
+    int mask;
+
+    names->table_size = names->table_size ? names->table_size * 2 : 256;
+    names->table = arena_alloc(names->arena, sizeof(int) * names->table_size);
+    mask = names->table_size - 1;
+
+    for (int i = 0; i < names->table_size; i++) {
+        names->table[i] = NIL;
+    }
+    for (int id = 0; id < names->num_names; id++) {
+        int pos = names->hash[id] & mask;
+        while (names->table[pos] != NIL) {
+            pos = (pos + 1) & mask;
+        }
+        names->table[pos] = id;
+    }
+}
+
+
+/** Initializes an empty intern table
+ * @param names   intern table
+ * @param arena   arena that will hold the names
+ */
+void set_names(Names *names, Arena *arena) {
+    names->arena = arena;
+    names->num_names = 0;
+    names->names_cap = 0;
+    names->offset = NULL;
+    names->hash = NULL;
+    names->pool_len = 0;
+    names->pool_cap = 0;
+    names->pool = NULL;
+    names->table_size = 0;
+    names->table = NULL;
+}
+
+
+/** Looks up the ID of a name without adding it
+ * @param names   intern table
+ * @param name   name to look for
+ * @return  ID of the name, NIL if it was never interned
+ */
+int find_name(Names *names, const char *name) {
+    if (names->table_size == 0) {
+        return NIL;
+    }
+    return names->table[name_position(names, name, hash_name(name))];
+}
+
+
+/** Returns the ID of a name, storing a copy of it if new
+ * @param names   intern table
+ * @param name   name to intern
+ * @return  ID of the name
+ */
+int intern(Names *names, const char *name) {
+    unsigned int hash = hash_name(name);
+    int len = strlen(name) + 1;
+    int id;
+
+    if (names->table_size != 0) {
+        id = names->table[name_position(names, name, hash)];
+        if (id != NIL) {
+            return id;
+        }
+    }
+    /* keep the table at most half full */
+    if (2 * (names->num_names + 1) > names->table_size) {
+        grow_name_table(names);
+    }
+    if (names->num_names >= names->names_cap) {
+        int old_cap = names->names_cap;
+        names->names_cap = names->names_cap ? names->names_cap * 2 : 256;
+        names->offset = arena_grow(names->arena, names->offset,
+            sizeof(int) * old_cap, sizeof(int) * names->names_cap);
+        names->hash = arena_grow(names->arena, names->hash,
+            sizeof(unsigned int) * old_cap,
+            sizeof(unsigned int) * names->names_cap);
+    }
+    if (names->pool_len + len > names->pool_cap) {
+        int old_cap = names->pool_cap;
+        while (names->pool_len + len > names->pool_cap) {
+            names->pool_cap = names->pool_cap ? names->pool_cap * 2 : 4096;
+        }
+        names->pool = arena_grow(names->arena, names->pool, old_cap,
+            names->pool_cap);
+    }
+
+    /* store the single copy of the name */
+    id = names->num_names++;
+    names->offset[id] = names->pool_len;
+    names->hash[id] = hash;
+    memcpy(names->pool + names->pool_len, name, len);
+    names->pool_len += len;
+
+    names->table[name_position(names, name, hash)] = id;
+    return id;
+}
+
+
+/** Returns the name of an ID
+ * @param names   intern table
+ * @param id   ID returned by intern()
+ * @details The pointer stays valid until free_system(), even across later
+intern() calls: a pool that grows is copied by arena_grow(), which keeps
+the old copy until the arena is freed, and a pool loaded from a snapshot
+stays in the mapping. The engine's views and record logs keep these
+pointers, so the pool must never release or reuse old copies
+ * @return  the name
+ */
+const char *name_of(Names *names, int id) {
+    return names->pool + names->offset[id];
+}
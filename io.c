@@ -0,0 +1,325 @@
+/**
+ * Vaccination Management System - Input and Output
+ * @brief: This file contains the block I/O layer of the program:
+ * - Line reader over large read() calls or a mmap of the input file
+ * - Output buffer with hand-written integer and date formatting
+ * @file: io.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "project.h"
+
+static char out_buf[OUTBLOCK];      /**< pending output */
+static size_t out_len;      /**< bytes pending in out_buf */
+static int out_muted;       /**< 1 while output is being dropped */
+static void (*flush_hook)(void *);      /**< runs before output is shown */
+static void *flush_ctx;     /**< argument of flush_hook */
+
+
+/** Drops or restores the output
+ * @param mute   1 to drop everything written from now on, 0 to restore
+ * @details Used while replaying commands whose answers were already given
+ */
+void mute_output(int mute) {
+    flush_output();
+    out_muted = mute;
+}
+
+
+/** Sets a function to run before any output is shown
+ * @param hook   function (NULL for none)
+ * @param ctx   argument given to hook
+ */
+void set_flush_hook(void (*hook)(void *), void *ctx) {
+    flush_hook = hook;
+    flush_ctx = ctx;
+}
+
+
+/** Writes all pending output to stdout
+ * @details Called whenever the buffer fills, before blocking for input and
+before leaving the program
+ */
+void flush_output(void) {
+    size_t done = 0;
+
+    if (out_muted) {
+        out_len = 0;
+        return;
+    }
+    if (flush_hook != NULL && out_len > 0) {
+        flush_hook(flush_ctx);
+    }
+    while (done < out_len) {
+        ssize_t n = write(STDOUT_FILENO, out_buf + done, out_len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) { /* stdout is gone, drop the output */
+            break;
+        }
+        done += n;
+    }
+    out_len = 0;
+}
+
+
+/** Appends bytes to the output
+ * @param data   bytes to write
+ * @param len   number of bytes
+ */
+static void write_bytes(const char *data, size_t len) {
+    if (out_len + len > OUTBLOCK) {
+        flush_output();
+        if (len > OUTBLOCK) { /* too big to buffer, write it through */
+            memcpy(out_buf, data, OUTBLOCK);
+            out_len = OUTBLOCK;
+            flush_output();
+            write_bytes(data + OUTBLOCK, len - OUTBLOCK);
+            return;
+        }
+    }
+    memcpy(out_buf + out_len, data, len);
+    out_len += len;
+}
+
+
+/** Appends a character to the output
+ * @param c   character
+ */
+void write_char(char c) {
+    if (out_len == OUTBLOCK) {
+        flush_output();
+    }
+    out_buf[out_len++] = c;
+}
+
+
+/** Appends a string to the output
+ * @param str   string
+ */
+void write_str(const char *str) {
+    write_bytes(str, strlen(str));
+}
+
+
+/** Appends a string and a newline to the output, like puts()
+ * @param str   string
+ */
+void write_line(const char *str) {
+    write_str(str);
+    write_char('\n');
+}
+
+
+/** Appends an error about a name, like printf("%s: %s\n")
+ * @param name   name the error is about
+ * @param error   error message
+ */
+void write_error(const char *name, const char *error) {
+    write_str(name);
+    write_bytes(": ", 2);
+    write_line(error);
+}
+
+
+/** Appends an integer with at least some digits, like printf("%0*lld")
+ * @param value   number
+ * @param width   minimum number of digits, padded with zeros
+ */
+static void write_padded(long long value, int width) {
+    char digits[24];
+    unsigned long long n = value < 0 ? -(unsigned long long)value :
+        (unsigned long long)value;
+    int len = 0;
+
+    do { /* digits come out backwards */
+        digits[len++] = '0' + n % 10;
+        n /= 10;
+    } while (n != 0);
+    while (len < width) {
+        digits[len++] = '0';
+    }
+    if (value < 0) {
+        write_char('-');
+    }
+    while (len > 0) {
+        write_char(digits[--len]);
+    }
+}
+
+
+/** Appends an integer to the output, like printf("%d")
+ * @param value   number
+ */
+void write_int(int value) {
+    write_padded(value, 1);
+}
+
+
+/** Appends a long integer to the output, like printf("%lld")
+ * @param value   number
+ */
+void write_long(long long value) {
+    write_padded(value, 1);
+}
+
+
+/** Appends a date to the output, like printf("%02d-%02d-%02d")
+ * @param date   date
+ */
+void write_date(const Date *date) {
+    write_padded(DATEDAY(*date), 2);
+    write_char('-');
+    write_padded(DATEMONTH(*date), 2);
+    write_char('-');
+    write_padded(DATEYEAR(*date), 2);
+}
+
+
+/** Starts reading lines from an open file descriptor
+ * @param in   reader structure
+ * @param fd   file descriptor
+ * @param idiom   language identifier, for the out-of-memory message
+ */
+void set_input(Reader *in, int fd, int idiom) {
+    in->fd = fd;
+    in->cap = INBLOCK;
+    in->buf = malloc(in->cap + 1);
+    check_allocation(in->buf, idiom);
+    in->len = 0;
+    in->pos = 0;
+    in->mapped = 0;
+    in->eof = 0;
+    in->idiom = idiom;
+}
+
+
+/** Starts reading lines from a file, mapping it in memory if possible
+ * @param in   reader structure
+ * @param path   path of the file
+ * @param idiom   language identifier, for the out-of-memory message
+ * @details The mapping is private and writable, so lines can be split in
+place without changing the file
+ * @return  0 if opened, 1 otherwise
+ */
+int open_input(Reader *in, const char *path, int idiom) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return 1;
+    }
+    set_input(in, fd, idiom);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            free(in->buf);
+            in->buf = map;
+            in->len = in->cap = st.st_size;
+            in->mapped = 1;
+            in->eof = 1;
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+        }
+    }
+    return 0;
+}
+
+
+/** Reads more input after the data not yet consumed
+ * @param in   reader structure
+ * @details Moves the pending partial line to the front of the buffer and
+doubles the buffer if that line fills it
+ */
+static void fill_input(Reader *in) {
+    ssize_t n;
+
+    if (in->pos > 0) {
+        memmove(in->buf, in->buf + in->pos, in->len - in->pos);
+        in->len -= in->pos;
+        in->pos = 0;
+    }
+    if (in->len == in->cap) { /* a line longer than the buffer */
+        in->cap *= 2;
+        in->buf = realloc(in->buf, in->cap + 1);
+        check_allocation(in->buf, in->idiom);
+    }
+    flush_output(); /* answers must be out before waiting for more input */
+    do {
+        n = read(in->fd, in->buf + in->len, in->cap - in->len);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        in->eof = 1;
+    } else {
+        in->len += n;
+    }
+}
+
+
+/** Returns the next line of input
+ * @param in   reader structure
+ * @details The newline is replaced by '\0' in place; the line stays valid
+until the next call
+ * @return  the line, NULL at the end of the input
+ */
+char *read_line(Reader *in) {
+    char *line, *end;
+
+    for (;;) {
+        line = in->buf + in->pos;
+        end = memchr(line, '\n', in->len - in->pos);
+        if (end != NULL) {
+            *end = '\0';
+            in->pos = end - in->buf + 1;
+            return line;
+        }
+        if (in->eof) {
+            break;
+        }
+        fill_input(in);
+    }
+    if (in->pos == in->len) {
+        return NULL;
+    }
+    /* last line without a newline */
+    if (in->mapped) { /* no room after it in the mapping, copy it out */
+        size_t len = in->len - in->pos;
+        char *copy = malloc(len + 1);
+        check_allocation(copy, in->idiom);
+        memcpy(copy, line, len);
+        munmap(in->buf, in->cap);
+        in->buf = copy;
+        in->len = in->cap = len;
+        in->pos = 0;
+        in->mapped = 0;
+        line = copy;
+    }
+    in->buf[in->len] = '\0';
+    in->pos = in->len;
+    return line;
+}
+
+
+/** Releases the reader and closes its file
+ * @param in   reader structure
+ */
+void close_input(Reader *in) {
+    if (in->mapped) {
+        munmap(in->buf, in->cap);
+    } else {
+        free(in->buf);
+    }
+    if (in->fd != STDIN_FILENO) {
+        close(in->fd);
+    }
+    in->buf = NULL;
+}
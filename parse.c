@@ -0,0 +1,179 @@
+/**
+ * Vaccination Management System - Command Parsing
+ * @brief: This file contains the tokenizer used by the command handlers:
+ * - Splitting of a line in place, without copies or allocations
+ * - Quoted user names, comma-separated fields of the import files
+ * - Hand-written integer and date parsers
+ * @file: parse.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include "project.h"
+
+/** Checks if a character separates tokens
+ * @param c   character
+ * @return  1 if separator, 0 otherwise
+ */
+static int is_separator(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+
+/** Returns the next token of a line, terminating it in place
+ * @param cursor   position in the line, advanced past the token
+ * @details The line is modified: the separator after the token becomes
+'\0', so the token can be used as a string with no copy
+ * @return  the token, NULL if the line has no more tokens
+ */
+char *next_token(char **cursor) {
+    char *p = *cursor, *token;
+
+    while (is_separator(*p)) {
+        p++;
+    }
+    if (*p == '\0') {
+        *cursor = p;
+        return NULL;
+    }
+    token = p;
+    while (*p != '\0' && !is_separator(*p)) {
+        p++;
+    }
+    if (*p != '\0') {
+        *p++ = '\0';
+    }
+    *cursor = p;
+    return token;
+}
+
+
+/** Returns the next user name of a line, which may be quoted
+ * @param cursor   position in the line, advanced past the name
+ * @details A quoted name runs to the closing quote (or the end of the line)
+and may contain spaces; the quotes are not part of the name
+ * @return  the name, NULL if the line has no more tokens
+ */
+char *next_name(char **cursor) {
+    char *p = *cursor, *name;
+
+    while (is_separator(*p)) {
+        p++;
+    }
+    if (*p != '"') {
+        *cursor = p;
+        return next_token(cursor);
+    }
+    name = ++p; /* skip the opening quote */
+    while (*p != '\0' && *p != '"' && *p != '\n') {
+        p++;
+    }
+    if (*p != '\0') {
+        *p++ = '\0';
+    }
+    *cursor = p;
+    return name;
+}
+
+
+/** Returns the next comma-separated field of a line, terminating it in
+place
+ * @param cursor   position in the line, advanced past the field and comma
+ * @details Fields are taken as they are, spaces included, and may be empty
+ * @return  the field, NULL if the line has no more fields
+ */
+char *next_field(char **cursor) {
+    char *p = *cursor, *field = p;
+
+    if (p == NULL) {
+        return NULL;
+    }
+    while (*p != '\0' && *p != ',') {
+        p++;
+    }
+    *cursor = *p == ',' ? p + 1 : NULL; /* NULL once the line is done */
+    *p = '\0';
+    return field;
+}
+
+
+/** Parses a decimal number
+ * @param token   token holding the number
+ * @param value   receives the number
+ * @details Accepts an optional sign; fails on any other character and on
+values that do not fit an int
+ * @return  0 if parsed, 1 otherwise
+ */
+int parse_int(const char *token, int *value) {
+    long result = 0;
+    int negative = 0;
+
+    if (token == NULL) {
+        return 1;
+    }
+    if (*token == '-' || *token == '+') {
+        negative = *token++ == '-';
+    }
+    if (*token == '\0') {
+        return 1;
+    }
+    for (; *token != '\0'; token++) {
+        if (*token < '0' || *token > '9') {
+            return 1;
+        }
+        result = result * 10 + (*token - '0');
+        if (result > INT_MAX) {
+            return 1;
+        }
+    }
+    *value = negative ? -(int)result : (int)result;
+    return 0;
+}
+
+
+/** Parses a run of digits of a date
+ * @param p   position in the token, advanced past the digits
+ * @param value   receives the number
+ * @return  0 if at least one digit was read, 1 otherwise
+ */
+static int parse_date_part(const char **p, int *value) {
+    const char *start = *p;
+    int result = 0;
+
+    while (**p >= '0' && **p <= '9') {
+        if (*p - start >= 9) { /* no date part is that long */
+            return 1;
+        }
+        result = result * 10 + (**p - '0');
+        (*p)++;
+    }
+    *value = result;
+    return *p == start;
+}
+
+
+/** Parses a date in DD-MM-YYYY format
+ * @param token   token holding the date
+ * @param date   receives the date (untouched if not parsed)
+ * @details Only checks the format; calendar rules are left to
+validate_date(). A field too big for its bits saturates, which keeps it
+after every valid date and equal to none
+ * @return  0 if parsed, 1 otherwise
+ */
+int parse_date(const char *token, Date *date) {
+    const char *p = token;
+    int day, month, year;
+
+    if (token == NULL || parse_date_part(&p, &day) || *p++ != '-' ||
+        parse_date_part(&p, &month) || *p++ != '-' ||
+        parse_date_part(&p, &year) || *p != '\0') {
+        return 1;
+    }
+    *date = DATE(day < DATEMAXDAY ? day : DATEMAXDAY,
+        month < DATEMAXMONTH ? month : DATEMAXMONTH,
+        year < DATEMAXYEAR ? year : DATEMAXYEAR);
+    return 0;
+}
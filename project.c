@@ -2,6 +2,8 @@
 /**
  * A program simulating a vaccination management system.
  * Handles batch registration, inoculation, and date management.
+ * This is the text front end of the engine: it parses each command, calls
+ * the library API (see vaccine.c) and prints the results.
  * @file: project.c
  * @author: ist1114455 (Marta Santos)
 */
@@ -9,6 +11,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
 
 #include "project.h"
 
@@ -17,47 +20,39 @@
  * @param sys system structure
  * @param input input line
  * @param idiom language identifier
- * @details Validates all input fields
+ * @details Missing or malformed fields are left invalid, to fail their
+validation in add_batch()
  */
-static void add_batch(Sys *sys, const char *input, int idiom) {
+static void register_batch(Sys *sys, char *input, int idiom) {
     /* variables to store batch info */
-    char batch_name[MAXBATCHNAME +1];
-    char vacc_name[MAXVACCNAME*10];
-    Date exp_date;
-    int doses;
-    
-    /* initialize batch slots */
-    set_batch_slots(sys->batches, sys->num_batch, sys->mem_capacity);
-    /* check if memory capacity needs to be increased */
-    if (sys->num_batch >= sys->mem_capacity) {
-        sys->mem_capacity = sys->mem_capacity ? sys->mem_capacity * 2 : 10;
-        sys->batches = realloc(sys->batches, sizeof(Batch)*sys->mem_capacity);
-        set_batch_slots(sys->batches, sys->num_batch, sys->mem_capacity);
-    }
-
-    sscanf(input, "c %s %d-%d-%d %d %s", batch_name,
-        &exp_date.day, &exp_date.month, &exp_date.year,
-        &doses, vacc_name);
-    
-    /* validation of the received data */
-    if (validate_batch_inputs(sys, batch_name, vacc_name, &exp_date,
-        doses, idiom)) {
-        return;
+    char *cursor = input + 1, *batch_name, *vacc_name;
+    Date exp_date = 0;
+    int doses = 0, error;
+
+    /* split the line; missing fields fail their validation */
+    if ((batch_name = next_token(&cursor)) == NULL) {
+        batch_name = cursor;
+    }
+    parse_date(next_token(&cursor), &exp_date);
+    parse_int(next_token(&cursor), &doses);
+    if ((vacc_name = next_token(&cursor)) == NULL) {
+        vacc_name = cursor;
     }
 
-    /* dinamic duplication of the strings */
-    sys->batches[sys->num_batch].batch_name = strdup(batch_name);
-    sys->batches[sys->num_batch].vacc_name = strdup(vacc_name);
-    /* store batch data */
-    sys->batches[sys->num_batch].exp_date = exp_date;
-    sys->batches[sys->num_batch].doses = doses;
+    error = add_batch(sys, batch_name, &exp_date, doses, vacc_name);
+    write_line(error == ERRNONE ? batch_name : error_message(error, idiom));
+}
 
-    check_allocation(sys->batches[sys->num_batch].batch_name, idiom);
-    check_allocation(sys->batches[sys->num_batch].vacc_name, idiom);
 
-    sys->num_batch++; /* increment batch count */
-    printf("%s\n", batch_name);
-    return;
+/** Prints a batch of a listing
+ * @param batch   batch listed
+ * @param ctx   unused
+ * @return  always 0, to list every batch
+ */
+static int print_batch(const BatchInfo *batch, void *ctx) {
+    (void)ctx;
+    print_batch_info(batch);
+    return 0;
 }
 
 
@@ -65,42 +60,73 @@ static void add_batch(Sys *sys, const char *input, int idiom) {
  * @param sys   system structure
  * @param input     input line
  * @param idiom     language identifier
- * @details Lists all batches or specific ones based on user input
+ * @details Lists all batches or those of each vaccine given, already
+sorted by the batch tree
  */
-static void list_batches(Sys *sys, char *input, int idiom) {
-    /* skips 'l' and space to help extract vacc name */
-    char *current = input + 2;
-    sort_batches(sys->batches, sys->num_batch);
-
-    if (*current == '\0') {
-        for (int i = 0; i < sys->num_batch; i++) {
-            print_batch_info(&sys->batches[i]);
+static void show_batches(Sys *sys, char *input, int idiom) {
+    char *cursor = input + 1; /* skips 'l' */
+    char *vacc_name = next_token(&cursor);
+
+    if (vacc_name == NULL) {
+        list_batches(sys, NULL, print_batch, NULL);
+        return;
+    }
+    /* list specific batches */
+    for (; vacc_name != NULL; vacc_name = next_token(&cursor)) {
+        int error = list_batches(sys, vacc_name, print_batch, NULL);
+        if (error != ERRNONE) {
+            write_error(vacc_name, error_message(error, idiom));
         }
     }
-    else {
-        /* list specific batches */
-        while (*current != '\0') {
-            char vacc_name[MAXVACCNAME + 1];
-            int len = 0; int found = 0;
+}
 
-            /* extract vacc name from input */
-            while (*current != ' ' && *current != '\0') {
-                vacc_name[len++] = *current++;
-            }
-            vacc_name[len] = '\0'; /* end string */
 
-            /* check if the last character is a newline */
-            if (vacc_name[len - 1] == '\n') vacc_name[len - 1] = '\0';
-            while (*current == ' ') current++; /* skip spaces between names */
+/** Prints the stock of a vaccine
+ * @param stock   vaccine listed
+ * @param ctx   unused
+ * @details Format: <vaccine_name> <doses> <applications> <batches>
+ <dd-mm-yyyy of the first to expire, - if none>
+ * @return  always 0, to list every vaccine
+ */
+static int print_stock(const StockInfo *stock, void *ctx) {
+    (void)ctx;
+    write_str(stock->vacc_name);
+    write_char(' ');
+    write_long(stock->doses);
+    write_char(' ');
+    write_long(stock->applied);
+    write_char(' ');
+    write_int(stock->batches);
+    write_char(' ');
+    if (stock->batches > 0) {
+        write_date(&stock->first_exp);
+    } else {
+        write_char('-');
+    }
+    write_char('\n');
+    return 0;
+}
 
-            for (int i = 0; i < sys->num_batch; i++) {
-                if (strcmp(sys->batches[i].vacc_name, vacc_name) == 0) {
-                    print_batch_info(&sys->batches[i]);
-                    found = 1;
-                }
-            }
-            if (!found) printf("%s: %s\n", vacc_name, idiom == 0 ?
-                ENOSVACC : ENOSVACCPT);
+
+/** Handles command 'v' to show the stock of vaccines
+ * @param sys   system structure
+ * @param input     input line
+ * @param idiom     language identifier
+ * @details Shows every vaccine or each one given (any case), from running
+totals, without walking the batches
+ */
+static void show_stock(Sys *sys, char *input, int idiom) {
+    char *cursor = input + 1; /* skips 'v' */
+    char *vacc_name = next_token(&cursor);
+
+    if (vacc_name == NULL) {
+        list_stock(sys, NULL, print_stock, NULL);
+        return;
+    }
+    for (; vacc_name != NULL; vacc_name = next_token(&cursor)) {
+        int error = list_stock(sys, vacc_name, print_stock, NULL);
+        if (error != ERRNONE) {
+            write_error(vacc_name, error_message(error, idiom));
         }
     }
 }
@@ -112,31 +138,18 @@ static void list_batches(Sys *sys, char *input, int idiom) {
  * @param idiom     language identifier
  */
 static void update_date(Sys *sys, char *input, int idiom) {
-    char *current = input + 2; /* skip 't' and space */
-    int day, month, year;
-
-    /* no argument given - show current date */
-    if (*current == '\0') {
-        printf("%02d-%02d-%02d\n", sys->today.day,
-            sys->today.month,
-            sys->today.year);
-        return;
-    }
-    else {
-        /* attempt to advance time */
-        sscanf(input, "t %02d-%02d-%d", &day, &month, &year);
-        Date new_date = {day, month, year};
-        if (validate_date(&new_date, sys)) {
-            puts(idiom == 0 ? EINVDATE : EINVDATEPT);
-            return;
-        }
-        sys->today = new_date; /* update */
-        printf("%02d-%02d-%02d\n",
-            sys->today.day,
-            sys->today.month,
-            sys->today.year);
+    char *cursor = input + 1; /* skip 't' */
+    char *token = next_token(&cursor);
+    Date new_date;
+
+    /* attempt to advance time, no argument given - show current date */
+    if (token != NULL && (parse_date(token, &new_date) ||
+        advance_date(sys, &new_date) != ERRNONE)) {
+        write_line(error_message(ERRINVDATE, idiom));
         return;
     }
+    write_date(&sys->today);
+    write_char('\n');
 }
 
 
@@ -144,43 +157,60 @@ static void update_date(Sys *sys, char *input, int idiom) {
  * @param sys   system structure
  * @param input     input line
  * @param idiom     language identifier
- * @details Checks if the user has already been vaccinated with the same
-vaccine today. If not, administers a vaccine dose having in consideration
-that the batch with at least one dose available with an older expiration date
-but still valid compared to the current date must be the chosen one
  */
 static void vaccinate(Sys *sys, char *input, int idiom) {
-    char user_name[BUFMAX];
-    char vacc_name[MAXVACCNAME*10];
-
-    extract_user(input, user_name);
-    /* extract vacc name based on the existence of quotation marks before */
-    sscanf(input + 2 + strlen(user_name) + (input[2] == '"' ? 3 : 1),
-    "%s", vacc_name);
-    sort_batches(sys->batches, sys->num_batch);
-
-    /* check for duplicate vaccination */
-    if (is_already_vaccinated(sys, user_name, vacc_name)) {
-        puts(idiom == 0 ? EALRVACC : EALRVACCPT);
-        return;
+    char *cursor = input + 1; /* skip 'a' */
+    char *user_name, *vacc_name;
+    const char *batch_name;
+    int error;
+
+    /* user name (maybe quoted) and vaccine name, missing ones are empty */
+    if ((user_name = next_name(&cursor)) == NULL) {
+        user_name = cursor;
+    }
+    if ((vacc_name = next_token(&cursor)) == NULL) {
+        vacc_name = cursor;
     }
-    expand_inocula_memory(sys);
 
-    /* find and use valid available batch */
-    for (int i = 0; i < sys->num_batch; i++) {
-        /* check for matching vacc with available doses */
-        if (strcasecmp(sys->batches[i].vacc_name, vacc_name) == 0 &&
-        sys->batches[i].doses > 0) {
+    error = administer(sys, user_name, vacc_name, &batch_name);
+    write_line(error == ERRNONE ? batch_name : error_message(error, idiom));
+}
 
-            /* apply vaccination and reduce doses */
-            sys->batches[i].doses--;
-            create_inocula(sys, &sys->batches[i], user_name, vacc_name, idiom);
-            return;
-        }
+
+/** Handles command 'm' to administer a vaccine to many users at once
+ * @param sys   system structure
+ * @param input     input line
+ * @param idiom     language identifier
+ * @details The line is the vaccine name and then the user names (maybe
+quoted). Prints one line per user, as 'a' would for each in turn
+ */
+static void mass_vaccinate(Sys *sys, char *input, int idiom) {
+    char *cursor = input + 1; /* skip 'm' */
+    char *vacc_name, *user_name;
+    /* every name takes at least a character and a separator */
+    int max_users = strlen(cursor) / 2 + 1, count = 0;
+    const char **user_names = malloc(sizeof(char *) * max_users);
+    const char **batch_names = malloc(sizeof(char *) * max_users);
+    int *errors = malloc(sizeof(int) * max_users);
+
+    check_allocation(user_names, idiom);
+    check_allocation(batch_names, idiom);
+    check_allocation(errors, idiom);
+    if ((vacc_name = next_token(&cursor)) == NULL) {
+        vacc_name = cursor;
     }
-    /* no stock available if loop completes without match */
-    puts(idiom == 0 ? ENOSTOCK : ENOSTOCKPT);
-    return;
+    while ((user_name = next_name(&cursor)) != NULL) {
+        user_names[count++] = user_name;
+    }
+
+    administer_many(sys, vacc_name, user_names, count, batch_names, errors);
+    for (int i = 0; i < count; i++) {
+        write_line(errors[i] == ERRNONE ? batch_names[i] :
+            error_message(errors[i], idiom));
+    }
+    free(user_names);
+    free(batch_names);
+    free(errors);
 }
 
 
@@ -188,43 +218,36 @@ static void vaccinate(Sys *sys, char *input, int idiom) {
  * @param sys   system structure
  * @param input     input line
  * @param idiom     language identifier
- * @details Handles both complete removal (if unused) and dose zeroing
- (if used), printing doses applied or error message, if batch can not be found
+ * @details Prints the doses applied from the batch, or an error message if
+it can not be found
  */
-static void delete_batch(Sys *sys, const char *input, int idiom) {
-    char batch_name[MAXBATCHNAME + 1];
-    sscanf(input, "r %s", batch_name);
-
-    int found = 0; /* batch existence flag */
-
-    /* search through all batches */
-    for (int i = 0; i < sys->num_batch; i++) {
-        if (strcmp(sys->batches[i].batch_name, batch_name) == 0) {
-            found = 1;
-
-            /* case in which batch has no applications - full removal */
-            if (sys->batches[i].num_app == 0) {
-                printf("0\n");
-                /* free allocated memory */
-                free(sys->batches[i].batch_name);
-                free(sys->batches[i].vacc_name);
-                /* moving elements */
-                for (int j = i; j < sys->num_batch - 1; j++) {
-                    sys->batches[j] = sys->batches[j + 1];
-                }
-                sys->num_batch--; /* decrement batch count */
-                return;
-            } else { /* case in which batch has applications */
-                sys->batches[i].doses = 0; /* reset doses */
-                printf("%d\n", sys->batches[i].num_app);
-                return;
-            }
-        }
+static void delete_batch(Sys *sys, char *input, int idiom) {
+    char *cursor = input + 1; /* skip 'r' */
+    char *batch_name = next_token(&cursor);
+    int applied, error;
+
+    if (batch_name == NULL) {
+        batch_name = cursor;
     }
-    /* batch not found */
-    if (!found) {
-        printf("%s: %s\n", batch_name, idiom == 0 ? ENOSBATCH : ENOSBATCHPT);
+    error = remove_batch(sys, batch_name, &applied);
+    if (error != ERRNONE) {
+        write_error(batch_name, error_message(error, idiom));
+        return;
     }
+    write_int(applied);
+    write_char('\n');
+}
+
+
+/** Prints a record of a listing
+ * @param inocula   record listed
+ * @param ctx   unused
+ * @return  always 0, to list every record
+ */
+static int print_inocula(const RecordInfo *inocula, void *ctx) {
+    (void)ctx;
+    print_inocula_info(inocula);
+    return 0;
 }
 
 
@@ -233,38 +256,65 @@ static void delete_batch(Sys *sys, const char *input, int idiom) {
  * @param input     input line
  * @param idiom     language identifier
  * @details Lists vaccination inoculations either for all users or a
-specific user, outputing inoculations in chronological order of application
+specific user, in chronological order of application
  */
 static void list_inoculas(Sys *sys, char *input, int idiom) {
-    char user_name[BUFMAX];
-    char *current = input + 1; /* skips 'u' and space in order
-    to extract user */
+    char *cursor = input + 1; /* skip 'u' */
+    char *user_name = next_name(&cursor);
+    int error = list_records(sys, user_name, print_inocula, NULL);
 
-    sort_inoculas(sys->inocula, sys->num_inocula);
+    if (error != ERRNONE) { /* user not found - error message */
+        write_error(user_name, error_message(error, idiom));
+    }
+}
 
-    /* case in which no username is provided - list all inoculations */
-    if (*current == '\0' || *current == '\n') {
-        for (int j = 0; j < sys->num_inocula; j++) {
-            print_inocula_info(&sys->inocula[j]);
-        }
+
+/** Handles command 'w' to list the inoculations of a date window
+ * @param sys   system structure
+ * @param input     input line
+ * @param idiom     language identifier
+ * @details Lists the inoculations from the first date to the second, both
+included, of every vaccine or of the one given (any case), by date
+ */
+static void list_window_inoculas(Sys *sys, char *input, int idiom) {
+    char *cursor = input + 1; /* skip 'w' */
+    char *from = next_token(&cursor), *to = next_token(&cursor);
+    char *vacc_name = next_token(&cursor);
+    Date first, last;
+    int error;
+
+    if (parse_date(from, &first) || parse_date(to, &last)) {
+        write_line(error_message(ERRINVDATE, idiom));
+        return;
     }
-    else { /* username is provided */
-        int found = 0; /* user existence flag */
-        extract_user(input, user_name);
+    error = list_window(sys, &first, &last, vacc_name, print_inocula, NULL);
+    if (error == ERRNOSVACC) {
+        write_error(vacc_name, error_message(error, idiom));
+    } else if (error != ERRNONE) {
+        write_line(error_message(error, idiom));
+    }
+}
 
-        /* search for corresponding user's inoculations */
-        for (int i = 0; i < sys->num_inocula; i++) {
-            if (strcmp(sys->inocula[i].user_name, user_name) == 0) {
-                /* print inoculation info */
-                print_inocula_info(&sys->inocula[i]);
-                found = 1;
-            }
-        }
-        if (!found) { /* user not found - error message */
-            printf("%s: %s\n", user_name, idiom == 0 ? ENOSUSER : ENOSUSERPT);
-        }
+
+/** Handles command 'b' to list the inoculations from a batch
+ * @param sys   system structure
+ * @param input     input line
+ * @param idiom     language identifier
+ * @details Lists the inoculations given from the batch, by date, walking
+only those
+ */
+static void list_batch_inoculas(Sys *sys, char *input, int idiom) {
+    char *cursor = input + 1; /* skip 'b' */
+    char *batch_name = next_token(&cursor);
+    int error;
+
+    if (batch_name == NULL) {
+        batch_name = cursor;
+    }
+    error = list_batch_records(sys, batch_name, print_inocula, NULL);
+    if (error != ERRNONE) {
+        write_error(batch_name, error_message(error, idiom));
     }
-    return;
 }
 
 
@@ -272,88 +322,370 @@ static void list_inoculas(Sys *sys, char *input, int idiom) {
  * @param sys   system structure
  * @param input     input line
  * @param idiom     language identifier
- * @details Deletes inoculation records based on user, date, and batch
+ * @details Deletes inoculation records based on user, date, and batch. The
+batch is only read after a date
  */
-static void delete_registration(Sys *sys, const char *input, int idiom) {
-    char user_name[MAXUSERNAME + 1]; char batch_name[MAXBATCHNAME + 1];
-    int day, month, year;
+static void delete_registration(Sys *sys, char *input, int idiom) {
+    char *cursor = input + 1; /* skip 'd' */
+    char *user_name = next_name(&cursor);
+    char *date = next_token(&cursor);
+    char *batch_name = next_token(&cursor);
+    Date ap_date = 0;
+    int deleted, error;
+
+    if (user_name == NULL) {
+        user_name = cursor;
+    }
+    if (date != NULL && parse_date(date, &ap_date)) {
+        /* a malformed date, reported after an unknown user */
+        error = is_user_found(sys, user_name) ? ERRINVDATE : ERRNOSUSER;
+    } else {
+        error = delete_records(sys, user_name, date != NULL ? &ap_date : NULL,
+            date != NULL ? batch_name : NULL, &deleted);
+    }
+    if (error == ERRNOSUSER || error == ERRNOSBATCH) {
+        write_error(error == ERRNOSUSER ? user_name : batch_name,
+            error_message(error, idiom));
+    } else if (error != ERRNONE) {
+        write_line(error_message(error, idiom));
+    } else { /* print results */
+        write_int(deleted);
+        write_char('\n');
+    }
+}
+
+
+/** Prints the batches retired by moving the date
+ * @param label   "last" or "total"
+ * @param expiry   the retirements
+ */
+static void print_expiry(const char *label, const Expiry *expiry) {
+    write_str(label);
+    write_str(" batches ");
+    write_int(expiry->batches);
+    write_str(" doses ");
+    write_long(expiry->doses);
+    write_char('\n');
+}
+
+
+/** Handles command 'e' to print the batches retired as expired
+ * @param sys   system structure
+ * @param input     input line
+ * @param idiom     language identifier
+ * @details One line for the last 't' and one for every 't' so far
+ */
+static void show_expiry(Sys *sys, char *input, int idiom) {
+    Expiry last, total;
+
+    (void)input;
+    (void)idiom;
+    expiry_summary(sys, &last, &total);
+    print_expiry("last", &last);
+    print_expiry("total", &total);
+}
 
-    /* (1-5 possible parameters) */
-    int num_param = sscanf(input, "d %s %d-%d-%d %s", user_name, &day, &month, &year, batch_name);
 
-    if (!is_user_found(sys, user_name)) { /* checks if user exists */
-        printf("%s: %s\n", user_name, idiom == 0 ? ENOSUSER : ENOSUSERPT);
+/** Handles command 's' to print the command statistics
+ * @param sys   system structure
+ * @param input     input line
+ * @param idiom     language identifier
+ * @details Only commands run while measuring (-m or -M) are counted
+ */
+static void show_stats(Sys *sys, char *input, int idiom) {
+    (void)sys;
+    (void)input;
+    if (!stats_enabled()) {
+        write_line(idiom == 0 ? ENOSTATS : ENOSTATSPT);
         return;
     }
-    if (num_param >= 4) { /* validate date if provided */
-        Date ap_date = {day, month, year};
-        if ((is_future_date(&ap_date, sys))) {
-            puts(idiom == 0 ? EINVDATE : EINVDATEPT);
-            return;
+    print_stats();
+}
+
+
+/** Runs one command line
+ * @param sys   system structure
+ * @param line   command line (split in place by the handlers)
+ * @param idiom   language identifier
+ */
+static void run_command(Sys *sys, char *line, int idiom) {
+    switch(line[0]) {
+        case 'c': register_batch(sys, line, idiom); break;
+        case 'l': show_batches(sys, line, idiom); break;
+        case 'a': vaccinate(sys, line, idiom); break;
+        case 'm': mass_vaccinate(sys, line, idiom); break;
+        case 'r': delete_batch(sys, line, idiom); break;
+        case 'u': list_inoculas(sys, line, idiom); break;
+        case 't': update_date(sys, line, idiom); break;
+        case 'd': delete_registration(sys, line, idiom); break;
+        case 's': show_stats(sys, line, idiom); break;
+        case 'e': show_expiry(sys, line, idiom); break;
+        case 'v': show_stock(sys, line, idiom); break;
+        case 'w': list_window_inoculas(sys, line, idiom); break;
+        case 'b': list_batch_inoculas(sys, line, idiom); break;
+        default: break;
+    }
+}
+
+
+/** Runs one command line, adding it to the command statistics
+ * @param sys   system structure
+ * @param line   command line (split in place by the handlers)
+ * @param idiom   language identifier
+ */
+static void run_measured(Sys *sys, char *line, int idiom) {
+    char command = line[0]; /* the handlers may split the line */
+    Probe probe;
+
+    start_probe(sys, &probe);
+    run_command(sys, line, idiom);
+    end_probe(sys, command, &probe);
+}
+
+
+/** Checks if a command may change the system, and so must be journaled
+ * @param command   command letter
+ * @return  1 if it may change the system, 0 otherwise
+ */
+static int is_mutating(char command) {
+    return command == 'c' || command == 'a' || command == 'm' ||
+        command == 'r' || command == 'd' || command == 't';
+}
+
+
+/** Replays the journal on top of the state loaded so far
+ * @param sys   system structure
+ * @param journal   journal, just opened
+ * @param idiom   language identifier
+ * @details Records already in the loaded snapshot are skipped; their
+answers were given before, so output is dropped meanwhile
+ * @return  0 if replayed, 1 if records are missing between the snapshot
+and the journal
+ */
+static int replay(Sys *sys, Journal *journal, int idiom) {
+    long long lsn;
+    char *line;
+
+    mute_output(1);
+    while ((line = replay_journal(journal, &lsn)) != NULL) {
+        if (lsn <= sys->lsn) { /* already in the snapshot */
+            continue;
+        }
+        if (lsn != sys->lsn + 1) {
+            mute_output(0);
+            return 1;
         }
+        sys->lsn = lsn;
+        run_command(sys, line, idiom);
     }
-    /* validate batch if provided */
-    if (num_param == 5 && !is_batch_found(sys, batch_name)) {
-        printf("%s: %s\n", batch_name, idiom == 0 ? ENOSBATCH : ENOSBATCHPT);
+    mute_output(0);
+    return 0;
+}
+
+
+/** Saves the snapshot asked for on the command line, if any
+ * @param sys   system structure
+ * @param path   path of the snapshot (NULL if none)
+ * @param journal   journal (NULL if none), emptied once the snapshot holds
+its records
+ * @param idiom   language identifier
+ */
+static void save_on_exit(Sys *sys, const char *path, Journal *journal,
+    int idiom) {
+    if (path == NULL) {
         return;
     }
-    
-    int total_deleted = 0; int new_index = 0;
+    if (save_snapshot(sys, path)) {
+        write_error(path, idiom == 0 ? ENOSAVE : ENOSAVEPT);
+    } else if (journal != NULL) {
+        reset_journal(journal);
+    }
+}
 
-    /* filter and compact inocula array */
-    for (int i = 0; i < sys->num_inocula; i++) {
-        if (delete_inocula(&sys->inocula[i], user_name, num_param, day, month, year, batch_name)) {
 
-            /* mark for deletion */
-            free_inocula(&sys->inocula[i]); total_deleted++;
-        } else if (new_index != i) {
+/** Runs a bulk import asked for on the command line and prints its summary
+ * @param sys   system structure
+ * @param path   path of the file
+ * @param records   1 for inoculations, 0 for batches
+ * @param threads   threads of an import of inoculations (0 for one per
+CPU)
+ * @param idiom   language identifier
+ * @details One line: <path>: <loaded> loaded <rejected> rejected; if any row
+was rejected, a second one with the first of them: <path>:<line>: <error>
+ * @return  0 if imported, 1 if the file cannot be opened
+ */
+static int run_import(Sys *sys, const char *path, int records, int threads,
+    int idiom) {
+    ImportSummary summary;
 
-            /* compact array by moving non-deleted elements */
-            sys->inocula[new_index++] = sys->inocula[i];
-        } else new_index++; /* advance index if no move needed */
+    if (records ? import_records(sys, path, threads, &summary) :
+        import_batches(sys, path, &summary)) {
+        return 1;
     }
+    write_str(path);
+    write_str(": ");
+    write_long(summary.loaded);
+    write_str(" loaded ");
+    write_long(summary.rejected);
+    write_str(" rejected\n");
+    if (summary.rejected > 0) {
+        write_str(path);
+        write_char(':');
+        write_long(summary.first_line);
+        write_str(": ");
+        write_line(error_message(summary.first_error, idiom));
+    }
+    return 0;
+}
+
 
-    /* update count and print results */
-    sys->num_inocula = new_index; printf("%d\n", total_deleted);
+/** Reports a file that cannot be used at startup and releases everything
+ * @param sys   system structure
+ * @param in   command input
+ * @param journal   journal (NULL if not open)
+ * @param path   path of the file
+ * @param error   error message
+ * @return  1, the exit status
+ */
+static int quit_on_error(Sys *sys, Reader *in, Journal *journal,
+    const char *path, const char *error) {
+    write_error(path, error);
+    if (journal != NULL) {
+        close_journal(journal);
+    }
+    free_system(sys);
+    close_input(in);
+    flush_output();
+    return 1;
 }
 
 
 /** Main program, manages the vaccination system
- * @return always returns 0
+ * @details Usage: project [pt] [-l snapshot] [-s snapshot] [-j journal]
+[-g group] [-c batches.csv] [-a inoculations.csv] [-p threads] [-m | -M]
+[file]. Commands
+are read from the file if given (mapped in memory), from stdin otherwise. -l
+starts from a snapshot, -s saves one when the input ends. -j journals every
+mutating command before it runs and replays the journal at startup; -g sets
+the records per commit. -c and -a bulk load batches, then past
+inoculations, before the first command (see import.c); with -j the snapshot
+is saved right after, as the journal does not hold them; -p sets the threads
+of -a (one per CPU by default, at most IMPORTTHREADS). -m measures every
+command for 's'; -M also prints the statistics on 'q'
+ * @return 0, or 1 if the input file, the snapshot, the journal or an import
+file cannot be used
  */
 int main (int argc, char *idiom[]) {
-    char buf[BUFMAX]; /* input buffer for commands */
+    char *buf; /* current command line */
+    const char *path = NULL; /* input file (NULL for stdin) */
+    const char *load = NULL, *save = NULL; /* snapshots (NULL if none) */
+    const char *log = NULL; /* journal (NULL if none) */
+    const char *batches = NULL, *records = NULL; /* imports (NULL if none) */
+    int group = JOURNALGROUP; /* journal records per commit */
+    int threads = 0; /* import threads (0 for one per CPU) */
+    int status; /* result of opening the snapshot or the journal */
+    int measure = 0, report = 0; /* -m and -M */
+    Reader in; /* command input */
+    Journal journal; /* journal of mutating commands */
     Sys sys; /* main system structure */
 
-    set_system(&sys);
-    
     int idioma = 0; /* default to english (0) */
 
-    /* portuguese idiom if 'pt' argument provided */
-    if (argc > 1 && strcmp(idiom[1], "pt") == 0) {
-        idioma = 1;
+    for (int i = 1; i < argc; i++) {
+        /* portuguese idiom if 'pt' argument provided */
+        if (strcmp(idiom[i], "pt") == 0) {
+            idioma = 1;
+        } else if (strcmp(idiom[i], "-l") == 0 && i + 1 < argc) {
+            load = idiom[++i];
+        } else if (strcmp(idiom[i], "-s") == 0 && i + 1 < argc) {
+            save = idiom[++i];
+        } else if (strcmp(idiom[i], "-j") == 0 && i + 1 < argc) {
+            log = idiom[++i];
+        } else if (strcmp(idiom[i], "-c") == 0 && i + 1 < argc) {
+            batches = idiom[++i];
+        } else if (strcmp(idiom[i], "-a") == 0 && i + 1 < argc) {
+            records = idiom[++i];
+        } else if (strcmp(idiom[i], "-m") == 0) {
+            measure = 1;
+        } else if (strcmp(idiom[i], "-M") == 0) {
+            measure = report = 1;
+        } else if (strcmp(idiom[i], "-g") == 0 && i + 1 < argc) {
+            if (parse_int(idiom[++i], &group) || group < 1) {
+                group = JOURNALGROUP;
+            }
+        } else if (strcmp(idiom[i], "-p") == 0 && i + 1 < argc) {
+            if (parse_int(idiom[++i], &threads) || threads < 1) {
+                threads = 0;
+            }
+        } else {
+            path = idiom[i];
+        }
+    }
+    if (path == NULL) {
+        set_input(&in, STDIN_FILENO, idioma);
+    } else if (open_input(&in, path, idioma)) {
+        write_error(path, idioma == 0 ? ENOFILE : ENOFILEPT);
+        flush_output();
+        return 1;
     }
 
-    /* allocate initial memory for batches and inoculations */
-    sys.batches = (Batch *)malloc(sizeof(Batch) * sys.mem_capacity);
-    sys.inocula = (Inocula *)malloc(sys.mem_capacity * sizeof(Inocula));
-    check_allocation(sys.batches, idioma);
-    check_allocation(sys.inocula, idioma);
+    set_system(&sys, idioma);
+    if (load != NULL && (status = load_snapshot(&sys, load)) != 0) {
+        return quit_on_error(&sys, &in, NULL, load, status == 1 ?
+            (idioma == 0 ? ENOFILE : ENOFILEPT) :
+            (idioma == 0 ? EINVSNAP : EINVSNAPPT));
+    }
+    if (log != NULL && (status = open_journal(&journal, log, idioma)) != 0) {
+        return quit_on_error(&sys, &in, NULL, log, status == 1 ?
+            (idioma == 0 ? ENOFILE : ENOFILEPT) :
+            (idioma == 0 ? EINVJOURNAL : EINVJOURNALPT));
+    }
+    if (log != NULL && replay(&sys, &journal, idioma)) {
+        return quit_on_error(&sys, &in, &journal, log,
+            idioma == 0 ? EINVJOURNAL : EINVJOURNALPT);
+    }
+    if (log != NULL && save == NULL && (batches != NULL || records != NULL)) {
+        return quit_on_error(&sys, &in, &journal, log,
+            idioma == 0 ? EIMPJOURNAL : EIMPJOURNALPT);
+    }
+    if (batches != NULL && run_import(&sys, batches, 0, threads, idioma)) {
+        return quit_on_error(&sys, &in, log != NULL ? &journal : NULL,
+            batches, idioma == 0 ? ENOFILE : ENOFILEPT);
+    }
+    if (records != NULL && run_import(&sys, records, 1, threads, idioma)) {
+        return quit_on_error(&sys, &in, log != NULL ? &journal : NULL,
+            records, idioma == 0 ? ENOFILE : ENOFILEPT);
+    }
+    if (log != NULL && (batches != NULL || records != NULL)) {
+        save_on_exit(&sys, save, &journal, idioma); /* checkpoint them */
+    }
+    if (log != NULL) { /* no answer is shown before its record is durable */
+        journal.group = group;
+        set_flush_hook(flush_journal, &journal);
+    }
+    enable_stats(measure); /* replayed commands are not measured */
 
     /* main command processing loop */
-    while (fgets(buf, BUFMAX, stdin)) {
-        switch(buf[0]) {
-            case 'c': add_batch(&sys, buf, idioma); break;
-            case 'l': list_batches(&sys, buf, idioma); break;
-            case 'a': vaccinate(&sys, buf, idioma); break;
-            case 'r': delete_batch(&sys, buf, idioma); break;
-            case 'u': list_inoculas(&sys, buf, idioma); break;
-            case 't': update_date(&sys, buf, idioma); break;
-            case 'd': delete_registration(&sys, buf, idioma); break;
-            case 'q': free_system(&sys); /* clean memory */
-            return 0;
-            default: break;
+    while ((buf = read_line(&in)) != NULL && buf[0] != 'q') {
+        if (log != NULL && is_mutating(buf[0])) {
+            log_command(&journal, ++sys.lsn, buf, strlen(buf));
         }
+        if (measure) {
+            run_measured(&sys, buf, idioma);
+        } else {
+            run_command(&sys, buf, idioma);
+        }
+    }
+    if (report && buf != NULL) { /* ended by 'q' */
+        print_stats();
     }
+    save_on_exit(&sys, save, log != NULL ? &journal : NULL, idioma);
+    flush_output();
+    if (log != NULL) {
+        set_flush_hook(NULL, NULL);
+        close_journal(&journal);
+    }
+    free_system(&sys); /* clean memory */
+    close_input(&in);
     return 0;
-}
\ No newline at end of file
+}
@@ -1,5 +1,8 @@
 #ifndef PROJECT_H
 #define PROJECT_H
+
+#include <stddef.h>
+#include <pthread.h>
 /**
  * @brief: This file contains the data structures and functions' prototypes.
  * @file: project.h
@@ -7,11 +10,54 @@
  */
 
 /* limits */
-#define BUFMAX 65535        /**< max. len. of input line	*/
 #define MAXBATCH 1000       /**< max. registered batches   */
 #define MAXBATCHNAME 20     /**< max. len. of batch name	*/
 #define MAXVACCNAME 50     /**< max. len. of vaccine name	*/
 #define MAXUSERNAME 200     /**< max. len. of user name	*/
+#define MINCOMPACT 64       /**< min. deleted records before compacting */
+#define ARENABLOCK 65536        /**< size of the first arena block */
+#define ARENAMAXBLOCK (64 << 20)        /**< max. size of an arena block */
+#define ARENAALIGN 16       /**< alignment of arena allocations */
+#define INBLOCK (1 << 20)       /**< size of an input read() */
+#define OUTBLOCK (1 << 18)      /**< size of the output buffer */
+
+/* snapshots */
+#define SNAPMAGIC "VACSNAP"     /**< first bytes of a snapshot file */
+#define SNAPVERSION 7       /**< version of the snapshot layout */
+#define SNAPORDER 0x01020304        /**< detects the byte order */
+#define SNAPALIGN 4096      /**< alignment of the snapshot sections */
+
+/* journal */
+#define JOURNALMAGIC "VACWAL1"      /**< first bytes of a journal file */
+#define JOURNALBLOCK 65536      /**< initial size of the record buffer */
+#define JOURNALGROUP 64     /**< max. records per commit */
+#define JOURNALWINDOW 10        /**< max. ms a record waits for its commit */
+
+/* statistics */
+#define STATCOMMANDS "clamrtudsevwb" /**< commands measured, in report order */
+#define STATSUBBITS 4       /**< log2 of the histogram buckets per doubling */
+#define STATMAXBITS 40      /**< latencies from 2^40 ns on share a bucket */
+#define STATBUCKETS ((STATMAXBITS - STATSUBBITS + 1) << STATSUBBITS)
+
+/* concurrent engine */
+#define EPOCHREADERS 64     /**< max. lock-free readers at once */
+#define LOGBITS 12      /**< log2 of the records per shard log chunk */
+#define LOGCHUNK (1 << LOGBITS)     /**< records per shard log chunk */
+
+/* bulk import */
+#define IMPORTTHREADS 64        /**< max. threads of an import */
+#define IMPORTBLOCK (4 << 20)       /**< file bytes per thread per round */
+
+/* growth policies */
+#define BATCHGROWTH 200     /**< growth of the batch array, in percent */
+#define INOCULAGROWTH 200       /**< growth of the chunk directory, in percent */
+#define CHUNKBITS 12        /**< log2 of the inoculations per chunk */
+#define CHUNKSIZE (1 << CHUNKBITS)      /**< inoculations per chunk */
+#define CHUNKWORDS (CHUNKSIZE / 64)     /**< words of a chunk's bitmap */
+
+/** field of the inoculation at index pos of the chunked record columns */
+#define INOCULA(sys, pos, field) \
+    ((sys)->chunks[(pos) >> CHUNKBITS]->field[(pos) & (CHUNKSIZE - 1)])
 
 /* errors */
 #define E2MANYVACC "too many vaccines"
@@ -26,6 +72,13 @@
 #define ENOSBATCH "no such batch"
 #define ENOSUSER "no such user"
 #define ENOMEMORY "No memory"
+#define ENOFILE "cannot open file"
+#define ENOSAVE "cannot write file"
+#define EINVSNAP "invalid snapshot"
+#define EINVJOURNAL "invalid journal"
+#define ENOJOURNAL "cannot write journal"
+#define ENOSTATS "statistics disabled"
+#define EIMPJOURNAL "importing with a journal needs a snapshot (-s)"
 
 /* erros */
 #define E2MANYVACCPT "demasiadas vacinas"
@@ -40,94 +93,586 @@
 #define ENOSBATCHPT "lote inexistente"
 #define ENOSUSERPT "utente inexistente"
 #define ENOMEMORYPT "sem memória"
+#define ENOFILEPT "impossível abrir ficheiro"
+#define ENOSAVEPT "impossível escrever ficheiro"
+#define EINVSNAPPT "snapshot inválido"
+#define EINVJOURNALPT "diário inválido"
+#define ENOJOURNALPT "impossível escrever diário"
+#define ENOSTATSPT "estatísticas desativadas"
+#define EIMPJOURNALPT "importar com diário requer um snapshot (-s)"
+
+/* result codes of the library calls (see error_message()) */
+#define ERRNONE 0
+#define ERR2MANYVACC 1
+#define ERRDUPBATCH 2
+#define ERRINVBATCH 3
+#define ERRINVNAME 4
+#define ERRINVDATE 5
+#define ERRINVQUANT 6
+#define ERRNOSVACC 7
+#define ERRNOSTOCK 8
+#define ERRALRVACC 9
+#define ERRNOSBATCH 10
+#define ERRNOSUSER 11
 
 #define EXITNOMEM -1
+#define EXITJOURNAL -2
+
+#define NIL -1      /**< empty link in the batch tree and free list */
+
+/** represents a date packed in one integer, year, month and day from the
+top bits down, so dates compare as integers (0 is never a valid date) */
+typedef unsigned int Date;
+
+#define DATEDAYBITS 6       /**< bits of the day of a Date */
+#define DATEMONTHBITS 5     /**< bits of the month of a Date */
+#define DATEYEARBITS (32 - DATEMONTHBITS - DATEDAYBITS)
+#define DATEMAXDAY ((1 << DATEDAYBITS) - 1)     /**< saturated day */
+#define DATEMAXMONTH ((1 << DATEMONTHBITS) - 1)     /**< saturated month */
+#define DATEMAXYEAR ((1 << DATEYEARBITS) - 1)       /**< saturated year */
+#define DATE(day, month, year) ((Date)(year) << (DATEMONTHBITS + \
+    DATEDAYBITS) | (Date)(month) << DATEDAYBITS | (Date)(day))
+#define DATEDAY(date) ((int)((date) & DATEMAXDAY))
+#define DATEMONTH(date) ((int)((date) >> DATEDAYBITS & DATEMAXMONTH))
+#define DATEYEAR(date) ((int)((date) >> (DATEMONTHBITS + DATEDAYBITS)))
+
+
+/* block of memory owned by an arena */
+typedef struct ArenaBlock {
+    struct ArenaBlock *prev;        /**< previously opened block */
+    size_t size;        /**< usable bytes in the block */
+    size_t used;        /**< bytes handed out */
+} ArenaBlock;
 
-/** represents a date in day-month-year format */
+
+/* bump allocator: memory is only released all at once */
+typedef struct {
+    ArenaBlock *block;      /**< current block (NULL if none) */
+    void *last;     /**< last allocation, which can grow in place */
+    size_t bytes;       /**< bytes handed out so far */
+    long resizes;       /**< allocations grown by arena_grow() */
+    int idiom;      /**< language of the out-of-memory message */
+} Arena;
+
+
+/* line reader over a file descriptor or a mapped file */
+typedef struct {
+    int fd;     /**< file being read */
+    char *buf;      /**< block buffer, or the whole mapped file */
+    size_t len;     /**< bytes of input in buf */
+    size_t pos;     /**< start of the next line */
+    size_t cap;     /**< allocated (or mapped) size of buf */
+    int mapped;     /**< 1 if buf is a mapping of the file */
+    int eof;        /**< 1 once the file has no more data to read */
+    int idiom;      /**< language of the out-of-memory message */
+} Reader;
+
+
+/* append-only journal of mutating commands */
 typedef struct {
-    int day, month, year;
-} Date;
+    int fd;     /**< journal file */
+    char *buf;      /**< records not yet written, or the one replayed */
+    size_t len;     /**< bytes used in buf */
+    size_t cap;     /**< allocated size of buf */
+    int pending;        /**< records appended since the last commit */
+    long long first_ms;     /**< when the oldest pending record came */
+    int group;      /**< records per commit */
+    int window;     /**< ms a record may wait for its commit */
+    long long end;      /**< size of the valid part of the file */
+    long long size;     /**< size of the file when opened */
+    int idiom;      /**< language of the error messages */
+} Journal;
+
+
+/* state of the system when a measured command starts */
+typedef struct {
+    long long start_ns;     /**< clock when it started */
+    size_t bytes;       /**< bytes taken from both arenas */
+    long resizes;       /**< arrays grown in both arenas */
+} Probe;
+
+
+/* stores every distinct user, vaccine and batch name once, by ID */
+typedef struct {
+    Arena *arena;       /**< arena holding the names and tables */
+    int num_names;      /**< number of names interned */
+    int names_cap;      /**< allocated size of offset/hash */
+    int *offset;        /**< position of each name in pool */
+    unsigned int *hash;     /**< hash of each name */
+    int pool_len;       /**< bytes used in pool */
+    int pool_cap;       /**< allocated size of pool */
+    char *pool;     /**< the names, '\0' terminated, back to back */
+    int table_size;     /**< size of table (power of 2) */
+    int *table;     /**< hash table of IDs */
+} Names;
 
 
 /* represents a vaccine batch in the system */
 typedef struct Batch {
-    char *vacc_name;        /**< name of vaccine        */
-    char *batch_name;       /**< name of batch      */
+    int vacc_id;        /**< ID of name of vaccine        */
+    int batch_id;       /**< ID of name of batch (NIL if slot free) */
     Date exp_date;      /**< expiration date        */
     int doses;       /**< number of doses        */
     int num_app;        /**< number of applications   */
+    int left, right;        /**< children in the batch tree (NIL if none) */
+    int height;     /**< height of the subtree rooted at this batch */
+    int vacc;       /**< index of its vaccine in the stock index */
+    int heap_pos;       /**< position in the vaccine stock (NIL if out) */
+    int rec_head, rec_tail;     /**< first and last record from it, in date
+    order (NIL if none) */
 } Batch;
 
 
+/* represents a vaccine and the batches that can currently supply it */
+typedef struct {
+    int name_id;        /**< ID of name of vaccine (as first registered) */
+    int *heap;      /**< min-heap of batch slots by ord_batches() */
+    int heap_len;       /**< number of batches in stock */
+    int heap_cap;       /**< allocated size of heap */
+    long long doses;        /**< doses left in the batches in stock */
+    long long applied;      /**< doses applied from all its batches */
+} Vaccine;
+
+
 /* represents a single vaccination record */
 typedef struct {
-    char *user_name;        /**< name of user vaccinated */
-    char *vacc_name;        /**< name of vaccine        */
-    char *batch_name;       /**< name of batch      */
+    int user_id;        /**< ID of name of user vaccinated (NIL if deleted) */
+    int vacc_id;        /**< ID of name of vaccine        */
+    int batch_id;       /**< ID of name of batch      */
     Date ap_date;       /**< date of vaccination     */
+    int next;       /**< next record of the same user (NIL if last) */
+    int batch_next;     /**< next record from the same batch (NIL if last) */
 } Inocula;
 
 
+/* CHUNKSIZE vaccination records stored by column, the fields of Inocula */
+typedef struct {
+    int user_id[CHUNKSIZE];     /**< users (NIL if deleted) */
+    int vacc_id[CHUNKSIZE];     /**< vaccines */
+    int batch_id[CHUNKSIZE];        /**< batches */
+    Date ap_date[CHUNKSIZE];        /**< dates of vaccination */
+    int next[CHUNKSIZE];        /**< next records of the same users */
+    int batch_next[CHUNKSIZE];      /**< next records from the same batches */
+} InoculaChunk;
+
+
+/* represents a user and the list of its vaccination records */
+typedef struct {
+    int head, tail;     /**< first and last record, in date order */
+    int count;      /**< number of records in the list */
+} User;
+
+
+/* batch as reported by list_batches() */
+typedef struct {
+    const char *batch_name;     /**< name of the batch */
+    const char *vacc_name;      /**< name of its vaccine */
+    Date exp_date;      /**< expiration date */
+    int doses;      /**< doses left */
+    int num_app;        /**< doses applied */
+} BatchInfo;
+
+
+/* vaccination record as reported by list_records() */
+typedef struct {
+    const char *user_name;      /**< name of the user vaccinated */
+    const char *vacc_name;      /**< name of the vaccine */
+    const char *batch_name;     /**< name of the batch */
+    Date ap_date;       /**< application date */
+} RecordInfo;
+
+
+/* stock of a vaccine as reported by list_stock() */
+typedef struct {
+    const char *vacc_name;      /**< name of the vaccine */
+    long long doses;        /**< doses left in stock */
+    long long applied;      /**< doses applied */
+    int batches;        /**< batches in stock */
+    Date first_exp;     /**< first expiration in stock (0 if none) */
+} StockInfo;
+
+
+/* outcome of a bulk import, one row per line */
+typedef struct {
+    long long loaded;       /**< rows loaded */
+    long long rejected;     /**< rows failing validation */
+    long long first_line;       /**< line of the first rejected row (0 if
+    none) */
+    int first_error;        /**< result code of that row */
+} ImportSummary;
+
+
+/* predicates of a scan of the inoculation columns, all of which must hold */
+typedef struct {
+    int user_id;        /**< ID of the user (NIL for any live record) */
+    int batch_id;       /**< ID of the batch (NIL for any) */
+    Date date;      /**< application date (0 for any) */
+    int vacc_id;        /**< ID of the vaccine (NIL for any) */
+} RecordFilter;
+
+
+/* key of the dose set: a user may get each vaccine once per day */
+typedef struct {
+    int user_id;        /**< ID of user (NIL if slot empty) */
+    int vacc_id;        /**< ID of vaccine        */
+    Date date;      /**< date of vaccination     */
+} DoseKey;
+
+
+/* batches retired from the stock as they expired */
+typedef struct {
+    int batches;        /**< batches retired */
+    long long doses;        /**< doses they still had */
+} Expiry;
+
+
 /* main system that holds all vaccination data and operational parameters */
 typedef struct {
-    int mem_capacity;       /**< inicial memory capacity for batches/inoculations */
+    int batch_capacity;     /**< allocated size of batches */
+    int batch_growth;       /**< growth of batches, in percent */
+    int num_chunks;     /**< inoculation chunks allocated */
+    int chunk_capacity;     /**< allocated size of chunks */
+    int inocula_growth;     /**< growth of chunks, in percent */
     int num_batch;      /**< number of batches registered */
-    int num_inocula;        /**< number of inoculations registered */
-    Batch *batches;     /**< array of batches */
+    int top_batch;      /**< number of batch slots ever used */
+    int free_batch;     /**< first free batch slot (NIL if none) */
+    int batch_root;     /**< root of the batch tree (NIL if empty) */
+    int num_inocula;        /**< number of inoculation slots used */
+    int num_dead;       /**< deleted inoculations not yet compacted */
+    Batch *batches;     /**< array of batch slots */
     Date today;      /**< current date */
-    Inocula *inocula;   /**< array of inoculations */
+    Expiry last_expiry;     /**< retired by the last date move */
+    Expiry total_expiry;        /**< retired by every date move */
+    InoculaChunk **chunks;  /**< inoculations, CHUNKSIZE per chunk; chunks
+    never move, so growing never copies records */
+    int num_vacc;       /**< number of vaccines ever registered */
+    int vacc_capacity;      /**< allocated size of vaccines */
+    Vaccine *vaccines;      /**< array of vaccines */
+    int vacc_table_size;        /**< size of vacc_table (power of 2) */
+    int *vacc_table;        /**< case-insensitive hash of vaccine names */
+    int dose_set_size;      /**< size of dose_set (power of 2) */
+    int dose_set_used;      /**< slots used, including removed keys */
+    int dose_set_live;      /**< keys currently in the set */
+    DoseKey *dose_set;      /**< hash set of inoculation keys */
+    DoseKey *dose_spare;        /**< spare table of the same size, reused
+    when a rehash only drops removed keys */
+    int user_capacity;      /**< allocated size of users */
+    User *users;        /**< users, indexed by ID of their name */
+    Names names;        /**< intern table of all names */
+    Arena batch_arena;      /**< batches and vaccine stock */
+    Arena record_arena;     /**< inoculations, their indexes and names */
+    long long lsn;      /**< journal records applied so far */
+    char *snap_map;     /**< loaded snapshot, mapped (NULL if none) */
+    size_t snap_size;       /**< size of snap_map */
 } Sys;
 
 
 
+/* memory retired by a writer, waiting for the readers that may use it */
+typedef struct Retired {
+    struct Retired *next;       /**< retired before it */
+    void *ptr;      /**< the old version */
+    void (*release)(void *);        /**< frees ptr */
+    unsigned long epoch;        /**< epoch it was retired in */
+} Retired;
+
+
+/* epochs of the readers of published versions */
+typedef struct {
+    unsigned long global;       /**< current epoch, from 1 */
+    unsigned long readers[EPOCHREADERS];        /**< epoch each reader
+    started in, 0 if idle */
+} Epochs;
+
+
+/* batch of a published version of the catalog */
+typedef struct {
+    BatchInfo info;     /**< the batch; info.doses is claimed atomically */
+    int total;      /**< doses left plus applied, fixed in the version */
+    int slot;       /**< batch slot in the catalog */
+} ViewRow;
+
+
+/* version of the catalog, read without locks and claimed from by 'a' */
+typedef struct {
+    int num_rows;       /**< number of batches */
+    ViewRow *rows;      /**< batches in (exp_date, batch_name) order */
+    int num_vacc;       /**< vaccines of the catalog */
+    int *stock;     /**< rows in stock, grouped by vaccine, in FEFO order */
+    int *start;     /**< vaccine v has stock[start[v]] to stock[start[v+1]] */
+    int *first;     /**< entries of a vaccine before it are empty or expired */
+} View;
+
+
+/* record of a shard, as published to readers */
+typedef struct {
+    RecordInfo info;        /**< the record; names stay valid with the engine */
+    int next;       /**< next record of the user (NIL until there is one) */
+} LogEntry;
+
+
+/* user of a shard, found by readers through its name */
+typedef struct {
+    const char *name;       /**< name of the user (NULL if slot empty) */
+    unsigned int hash;      /**< hash of name */
+    int head;       /**< first record */
+    int tail;       /**< last record, only used by the writer */
+} LogUser;
+
+
+/* hash table of the users of a shard, replaced as a whole when it grows */
+typedef struct {
+    int size;       /**< number of slots (power of 2) */
+    LogUser *users;     /**< open addressing slots */
+} LogTable;
+
+
+/* append-only records of a shard: readers see a prefix of len records */
+typedef struct {
+    LogEntry **chunks;      /**< chunks of LOGCHUNK records, replaced as a
+    whole when it grows */
+    int num_chunks;     /**< chunks allocated */
+    int chunk_cap;      /**< allocated size of chunks */
+    int len;        /**< records published */
+    LogTable *table;        /**< users of the shard */
+    int num_users;      /**< users in table */
+} RecordLog;
+
+
+/* records of the users whose names hash to one shard of the engine */
+typedef struct {
+    pthread_mutex_t lock;       /**< held by the writers of the shard */
+    Sys sys;        /**< names and dose set of its users */
+    RecordLog log;      /**< its records */
+    Retired *retired;       /**< old tables and chunk lists of the log */
+} Shard;
+
+
+/* concurrent engine: one batch catalog, records sharded by user */
+typedef struct {
+    Sys catalog;        /**< batches and vaccines, without records */
+    pthread_rwlock_t lock;      /**< shared by 'a', exclusive for c, r, t */
+    View *view;     /**< current version of the catalog */
+    Retired *retired;       /**< old versions of the catalog */
+    Epochs epochs;      /**< readers running without locks */
+    int num_shards;     /**< number of shards */
+    Shard *shards;      /**< record shards */
+    int idiom;      /**< language of the out-of-memory message */
+} Engine;
+
+
 /* validations */
-int validate_dup_batch_name(int num, Batch *batches, char *batch_name);
-int validate_batch_name_max(char *batch_name);
-int validate_batch_name_caract(char *batch_name);
-int validate_vacc_name(char *vacc_name);
+int validate_dup_batch_name(Sys *sys, const char *batch_name);
+int validate_batch_name_max(const char *batch_name);
+int validate_batch_name_caract(const char *batch_name);
+int validate_vacc_name(const char *vacc_name);
 int validate_doses(int doses);
-int validate_date(Date *date, Sys *sys);
-int validate_batch_inputs(Sys *sys, char *batch_name, char *vacc_name,
-    Date *exp_date, int doses, int idiom);
+int validate_date(const Date *date, Sys *sys);
+int validate_calendar(const Date *date);
+int validate_batch_inputs(Sys *sys, const char *batch_name,
+    const char *vacc_name, const Date *exp_date, int doses);
+
+int is_future_date(const Date *date, Sys *sys);
+int is_user_found(Sys *sys, const char *user_name);
+int is_batch_found(Sys *sys, const char *batch_name);
+int is_already_vaccinated(Sys *sys, const char *user_name,
+    const char *vacc_name);
+
+
+/* ordering batches/inoculations by date */
+int ord_date(const Date *a, const Date *b);
+int ord_batches(Sys *sys, Batch *a, Batch *b);
+
+
+/* name interning */
+void set_names(Names *names, Arena *arena);
+unsigned int hash_name(const char *name);
+int find_name(Names *names, const char *name);
+int intern(Names *names, const char *name);
+const char *name_of(Names *names, int id);
 
-int is_future_date(Date *date, Sys *sys);
-int is_user_found(Sys *sys, char *user_name);
-int is_batch_found(Sys *sys, char *batch_name);
-int is_already_vaccinated(Sys *sys, char *user_name, char *vacc_name);
 
+/* batch tree (always in ord_batches order) */
+int insert_batch_node(Sys *sys, int node, int slot);
+int remove_batch_node(Sys *sys, int node, int slot);
+int visit_batches(Sys *sys, int node,
+    int (*visit)(Sys *, Batch *, void *), void *ctx);
+int visit_expiring(Sys *sys, int node, Date from, Date to,
+    int (*visit)(Sys *, Batch *, void *), void *ctx);
+int find_batch(Sys *sys, const char *batch_name);
+int new_batch_slot(Sys *sys);
+void free_batch_slot(Sys *sys, int slot);
 
-/* sorting batches/inoculations by date */
-int ord_date(Date *a, Date *b);
-int ord_batches(Batch *a, Batch *b);
-void sort_batches(Batch *batches, int num_batch);
 
-int ord_inoculas(Inocula *a, Inocula *b);
-void sort_inoculas(Inocula *inocula, int num_inocula);
+/* vaccine stock (FEFO dose allocation) */
+int find_vaccine(Sys *sys, const char *name);
+int add_vaccine(Sys *sys, int vacc_id);
+void push_stock(Sys *sys, int slot);
+void remove_stock(Sys *sys, int slot);
+void retire_expired(Sys *sys, Date from);
+Batch *next_stock(Sys *sys, const char *vacc_name);
+void take_dose(Sys *sys, Batch *batch);
+void claim_stock(Sys *sys, int slot, int doses);
+void read_stock(Sys *sys, int vacc, StockInfo *stock);
+
+
+/* inoculation indexes */
+int has_dose_key(Sys *sys, int user_id, int vacc_id, Date *date);
+void add_dose_key(Sys *sys, Inocula *inocula);
+void remove_dose_key(Sys *sys, Inocula *inocula);
+void reserve_dose_keys(Sys *sys, int count);
+int add_shared_dose_key(Sys *sys, const DoseKey *key);
+int find_user(Sys *sys, const char *user_name);
+void link_user_record(Sys *sys, int pos);
+void unlink_user_record(Sys *sys, int user, int prev, int pos);
+void rebuild_user_index(Sys *sys);
+void link_batch_record(Sys *sys, int pos, int slot);
+void rebuild_batch_index(Sys *sys);
+void compact_inoculas(Sys *sys);
 
 
 /* prints info */
-void print_batch_info(const Batch *batch);
-void print_inocula_info(const Inocula *inocula);
+void print_batch_info(const BatchInfo *batch);
+void print_inocula_info(const RecordInfo *inocula);
+
+
+/* block input and buffered output */
+void set_input(Reader *in, int fd, int idiom);
+int open_input(Reader *in, const char *path, int idiom);
+char *read_line(Reader *in);
+void close_input(Reader *in);
+void write_char(char c);
+void write_str(const char *str);
+void write_line(const char *str);
+void write_error(const char *name, const char *error);
+void write_int(int value);
+void write_long(long long value);
+void write_date(const Date *date);
+void flush_output(void);
+void mute_output(int mute);
+void set_flush_hook(void (*hook)(void *), void *ctx);
 
 
-/* extracts user name from input */
-void extract_user(char *input, char *user_name);
+/* command parsing (tokens are split in place in the input line) */
+char *next_token(char **cursor);
+char *next_name(char **cursor);
+char *next_field(char **cursor);
+int parse_int(const char *token, int *value);
+int parse_date(const char *token, Date *date);
 
 
 /* inoculation management */
-int delete_inocula(const Inocula *inocula, const char *user_name,
-    int num_param, int day, int month, int year, const char *batch_name);
-void create_inocula(Sys *sys, Batch *batch, char *user_name,
-    char *vacc_name, int idiom);
+int delete_inocula(Sys *sys, int pos, int user_id, const Date *date,
+    int batch_id);
+int date_position(Sys *sys, Date date);
+void load_inocula(Sys *sys, int pos, Inocula *inocula);
+void store_inocula(Sys *sys, int pos, const Inocula *inocula);
+void create_inocula(Sys *sys, int slot, const char *user_name,
+    const char *vacc_name);
+
+
+/* record filters (SIMD kernels over the inoculation columns) */
+void filter_chunk(const InoculaChunk *chunk, int count,
+    const RecordFilter *filter, unsigned long long *bits);
+int compact_records(Sys *sys, const RecordFilter *filter);
+
+
+/* library API (libvaccine): typed operations, no text in or out */
+int add_batch(Sys *sys, const char *batch_name, const Date *exp_date,
+    int doses, const char *vacc_name);
+int administer(Sys *sys, const char *user_name, const char *vacc_name,
+    const char **batch_name);
+int administer_many(Sys *sys, const char *vacc_name,
+    const char *const *user_names, int count, const char **batch_names,
+    int *errors);
+int remove_batch(Sys *sys, const char *batch_name, int *applied);
+int delete_records(Sys *sys, const char *user_name, const Date *date,
+    const char *batch_name, int *deleted);
+int list_batches(Sys *sys, const char *vacc_name,
+    int (*visit)(const BatchInfo *, void *), void *ctx);
+int list_records(Sys *sys, const char *user_name,
+    int (*visit)(const RecordInfo *, void *), void *ctx);
+int list_window(Sys *sys, const Date *from, const Date *to,
+    const char *vacc_name, int (*visit)(const RecordInfo *, void *),
+    void *ctx);
+int list_batch_records(Sys *sys, const char *batch_name,
+    int (*visit)(const RecordInfo *, void *), void *ctx);
+int list_stock(Sys *sys, const char *vacc_name,
+    int (*visit)(const StockInfo *, void *), void *ctx);
+int advance_date(Sys *sys, const Date *date);
+void expiry_summary(Sys *sys, Expiry *last, Expiry *total);
+const char *error_message(int error, int idiom);
+
+
+/* concurrent engine (many threads may administer at once) */
+void set_engine(Engine *engine, int num_shards, int idiom);
+void free_engine(Engine *engine);
+int engine_add_batch(Engine *engine, const char *batch_name,
+    const Date *exp_date, int doses, const char *vacc_name);
+int engine_remove_batch(Engine *engine, const char *batch_name,
+    int *applied);
+int engine_advance_date(Engine *engine, const Date *date);
+int engine_administer(Engine *engine, const char *user_name,
+    const char *vacc_name, const char **batch_name);
+int engine_list_batches(Engine *engine, const char *vacc_name,
+    int (*visit)(const BatchInfo *, void *), void *ctx);
+int engine_list_records(Engine *engine, const char *user_name,
+    int (*visit)(const RecordInfo *, void *), void *ctx);
+
+
+/* epoch-based reclamation */
+void set_epochs(Epochs *epochs);
+int enter_epoch(Epochs *epochs);
+void exit_epoch(Epochs *epochs, int slot);
+void retire(Epochs *epochs, Retired **list, void *ptr,
+    void (*release)(void *));
+void reclaim(Epochs *epochs, Retired **list);
+
+
+/* snapshots */
+int save_snapshot(Sys *sys, const char *path);
+int load_snapshot(Sys *sys, const char *path);
+
+
+/* bulk import (CSV files of batches and of past inoculations) */
+int import_batches(Sys *sys, const char *path, ImportSummary *summary);
+int import_records(Sys *sys, const char *path, int threads,
+    ImportSummary *summary);
+
+
+/* journal */
+int open_journal(Journal *journal, const char *path, int idiom);
+char *replay_journal(Journal *journal, long long *lsn);
+void log_command(Journal *journal, long long lsn, const char *line,
+    size_t len);
+void commit_journal(Journal *journal);
+void flush_journal(void *ctx);
+int reset_journal(Journal *journal);
+void close_journal(Journal *journal);
+
+
+/* command statistics */
+void enable_stats(int enable);
+int stats_enabled(void);
+void start_probe(Sys *sys, Probe *probe);
+void end_probe(Sys *sys, char command, const Probe *probe);
+void print_stats(void);
 
 
 /* initializations and memory management */
 void set_batch_slots(Batch *batches, int start, int end);
-void set_system(Sys *sys);
+void set_system(Sys *sys, int idiom);
 void free_system(Sys *sys);
 
+void set_arena(Arena *arena, int idiom);
+void *arena_alloc(Arena *arena, size_t size);
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+void free_arena(Arena *arena);
+
+int grow_capacity(int capacity, int growth);
+void reserve_inocula(Sys *sys, int count);
 void expand_inocula_memory(Sys *sys);
-void free_inocula(Inocula *inocula);
+void free_inocula(Sys *sys, int pos);
 
 void check_allocation(void *ptr, int idiom);
 
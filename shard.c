@@ -0,0 +1,606 @@
+/**
+ * Vaccination Management System - Concurrent Engine
+ * @brief: This file contains the multi-threaded engine for 'a' requests:
+ * - One batch catalog, changed only under the exclusive side of a
+ * reader-writer lock (registering, removing batches, advancing the date)
+ * - Records sharded by user name hash, each shard a Sys of its own behind
+ * a mutex, so the already-vaccinated check and the new record are atomic
+ * for a user
+ * - Lock-free FEFO dose claims: a compare-and-swap on the doses of a batch,
+ * retried until it takes a dose or finds the batch empty
+ * - Lock-free reads: listings use published versions of the catalog and
+ * append-only record logs, reclaimed by epochs (see epoch.c), so they
+ * never wait for writers nor make them wait
+ * Built with -pthread.
+ * @file: shard.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "project.h"
+
+/** Hashes a user name to its shard (FNV-1a)
+ * @param name   name of the user
+ * @return  hash value
+ */
+static unsigned int hash_user(const char *name) {
+    unsigned int hash = 2166136261u;
+
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash;
+}
+
+
+/** Frees a version of the catalog
+ * @param ptr   the View
+ */
+static void free_view(void *ptr) {
+    View *view = ptr;
+
+    free(view->rows);
+    free(view->stock);
+    free(view->start);
+    free(view->first);
+    free(view);
+}
+
+
+/** Frees a table of users of a log
+ * @param ptr   the LogTable
+ */
+static void free_table(void *ptr) {
+    LogTable *table = ptr;
+
+    free(table->users);
+    free(table);
+}
+
+
+/** Adds a batch to the version being built
+ * @param sys   the catalog
+ * @param batch   batch structure
+ * @param ctx   the View
+ * @return  always 0, to visit every batch
+ */
+static int add_row(Sys *sys, Batch *batch, void *ctx) {
+    View *view = ctx;
+    ViewRow *row = &view->rows[view->num_rows++];
+
+    row->info.batch_name = name_of(&sys->names, batch->batch_id);
+    row->info.vacc_name = name_of(&sys->names, batch->vacc_id);
+    row->info.exp_date = batch->exp_date;
+    row->info.doses = batch->doses;
+    row->info.num_app = batch->num_app;
+    row->total = batch->doses + batch->num_app;
+    row->slot = batch - sys->batches;
+    if (batch->heap_pos != NIL) { /* in stock: counted for its vaccine */
+        view->start[batch->vacc + 1]++;
+    }
+    return 0;
+}
+
+
+/** Publishes a new version of the catalog, retiring the current one
+ * @param engine   engine structure, held exclusively
+ * @details The stock of each vaccine keeps the tree order, which is the
+FEFO order
+ */
+static void publish_view(Engine *engine) {
+    Sys *catalog = &engine->catalog;
+    View *view = malloc(sizeof(View)), *old = engine->view;
+
+    check_allocation(view, engine->idiom);
+    view->num_rows = 0;
+    view->num_vacc = catalog->num_vacc;
+    view->rows = malloc(sizeof(ViewRow) * (catalog->num_batch + 1));
+    view->stock = malloc(sizeof(int) * (catalog->num_batch + 1));
+    view->start = calloc(view->num_vacc + 1, sizeof(int));
+    view->first = malloc(sizeof(int) * (view->num_vacc + 1));
+    check_allocation(view->rows, engine->idiom);
+    check_allocation(view->stock, engine->idiom);
+    check_allocation(view->start, engine->idiom);
+    check_allocation(view->first, engine->idiom);
+
+    visit_batches(catalog, catalog->batch_root, add_row, view);
+    for (int v = 0; v < view->num_vacc; v++) {
+        view->start[v + 1] += view->start[v];
+        view->first[v] = view->start[v]; /* fill cursor, then claim hint */
+    }
+    for (int i = 0; i < view->num_rows; i++) {
+        Batch *batch = &catalog->batches[view->rows[i].slot];
+        if (batch->heap_pos != NIL) {
+            view->stock[view->first[batch->vacc]++] = i;
+        }
+    }
+    for (int v = 0; v < view->num_vacc; v++) {
+        view->first[v] = view->start[v];
+    }
+
+    __atomic_store_n(&engine->view, view, __ATOMIC_SEQ_CST);
+    if (old != NULL) {
+        retire(&engine->epochs, &engine->retired, old, free_view);
+    }
+}
+
+
+/** Writes the doses claimed in the current version back to the catalog
+ * @param engine   engine structure, held exclusively
+ * @details Batches emptied by claims leave the catalog's stock, and the
+vaccine totals follow, so the catalog is consistent again
+ */
+static void sync_view(Engine *engine) {
+    View *view = engine->view;
+
+    for (int i = 0; i < view->num_rows; i++) {
+        claim_stock(&engine->catalog, view->rows[i].slot,
+            view->rows[i].info.doses);
+    }
+}
+
+
+/** Initializes an empty engine
+ * @param engine   engine structure
+ * @param num_shards   number of record shards (at least 1)
+ * @param idiom   language identifier, for the out-of-memory message
+ */
+void set_engine(Engine *engine, int num_shards, int idiom) {
+    set_system(&engine->catalog, idiom);
+    pthread_rwlock_init(&engine->lock, NULL);
+    set_epochs(&engine->epochs);
+    engine->idiom = idiom;
+    engine->view = NULL;
+    engine->retired = NULL;
+    publish_view(engine);
+    engine->num_shards = num_shards > 0 ? num_shards : 1;
+    engine->shards = malloc(sizeof(Shard) * engine->num_shards);
+    check_allocation(engine->shards, idiom);
+    for (int i = 0; i < engine->num_shards; i++) {
+        Shard *shard = &engine->shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        set_system(&shard->sys, idiom);
+        shard->log.chunks = NULL;
+        shard->log.num_chunks = 0;
+        shard->log.chunk_cap = 0;
+        shard->log.len = 0;
+        shard->log.table = NULL;
+        shard->log.num_users = 0;
+        shard->retired = NULL;
+    }
+}
+
+
+/** Releases everything held by an engine
+ * @param engine   engine structure, with no call running
+ */
+void free_engine(Engine *engine) {
+    for (int i = 0; i < engine->num_shards; i++) {
+        Shard *shard = &engine->shards[i];
+        for (int c = 0; c < shard->log.num_chunks; c++) {
+            free(shard->log.chunks[c]);
+        }
+        free(shard->log.chunks);
+        if (shard->log.table != NULL) {
+            free_table(shard->log.table);
+        }
+        reclaim(&engine->epochs, &shard->retired);
+        pthread_mutex_destroy(&shard->lock);
+        free_system(&shard->sys);
+    }
+    free(engine->shards);
+    free_view(engine->view);
+    reclaim(&engine->epochs, &engine->retired);
+    pthread_rwlock_destroy(&engine->lock);
+    free_system(&engine->catalog);
+}
+
+
+/** Registers a new batch, as add_batch()
+ * @param engine   engine structure
+ * @param batch_name   name of the batch
+ * @param exp_date   expiration date
+ * @param doses   number of doses
+ * @param vacc_name   name of the vaccine
+ * @details Waits for the running claims to finish
+ * @return  ERRNONE, or the first validation that failed
+ */
+int engine_add_batch(Engine *engine, const char *batch_name,
+    const Date *exp_date, int doses, const char *vacc_name) {
+    int error;
+
+    pthread_rwlock_wrlock(&engine->lock);
+    sync_view(engine);
+    error = add_batch(&engine->catalog, batch_name, exp_date, doses,
+        vacc_name);
+    if (error == ERRNONE) {
+        publish_view(engine);
+    }
+    pthread_rwlock_unlock(&engine->lock);
+    return error;
+}
+
+
+/** Removes a batch, or only its remaining doses if it was used, as
+remove_batch()
+ * @param engine   engine structure
+ * @param batch_name   name of the batch
+ * @param applied   receives the doses applied from it (NULL to ignore)
+ * @return  ERRNONE or ERRNOSBATCH
+ */
+int engine_remove_batch(Engine *engine, const char *batch_name,
+    int *applied) {
+    int error;
+
+    pthread_rwlock_wrlock(&engine->lock);
+    sync_view(engine);
+    error = remove_batch(&engine->catalog, batch_name, applied);
+    if (error == ERRNONE) {
+        publish_view(engine);
+    }
+    pthread_rwlock_unlock(&engine->lock);
+    return error;
+}
+
+
+/** Moves the date of the catalog and of every shard forward
+ * @param engine   engine structure
+ * @param date   new date
+ * @details Expired batches leave the catalog's stock but stay in the
+version; claims skip them
+ * @return  ERRNONE, or ERRINVDATE if it is not a valid date from today on
+ */
+int engine_advance_date(Engine *engine, const Date *date) {
+    int error;
+
+    pthread_rwlock_wrlock(&engine->lock);
+    sync_view(engine); /* so the expiry summary counts the doses left */
+    error = advance_date(&engine->catalog, date);
+    if (error == ERRNONE) {
+        for (int i = 0; i < engine->num_shards; i++) {
+            engine->shards[i].sys.today = *date;
+        }
+    }
+    pthread_rwlock_unlock(&engine->lock);
+    return error;
+}
+
+
+/** Takes a dose from the first expiring batch of a vaccine that has one
+ * @param engine   engine structure, held shared
+ * @param view   current version
+ * @param vacc_name   name of the vaccine (any case)
+ * @details Doses only go down within a version, so a batch found empty or
+expired stays so, and the next claims start after it. The compare-and-swap
+fails only when another thread took a dose of the same batch first; it is
+then retried with the new count
+ * @return  the batch the dose came from, NULL if there is no stock
+ */
+static ViewRow *claim_dose(Engine *engine, View *view,
+    const char *vacc_name) {
+    Sys *catalog = &engine->catalog;
+    int vacc = find_vaccine(catalog, vacc_name);
+
+    if (vacc == NIL || vacc >= view->num_vacc) {
+        return NULL;
+    }
+    for (int i = __atomic_load_n(&view->first[vacc], __ATOMIC_ACQUIRE);
+        i < view->start[vacc + 1]; i++) {
+        ViewRow *row = &view->rows[view->stock[i]];
+        int doses = __atomic_load_n(&row->info.doses, __ATOMIC_ACQUIRE);
+        int expected = i;
+
+        if (row->info.exp_date >= catalog->today) {
+            while (doses > 0) {
+                if (__atomic_compare_exchange_n(&row->info.doses, &doses,
+                    doses - 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                    return row;
+                }
+            }
+        }
+        /* empty or expired for good: skip it from now on */
+        __atomic_compare_exchange_n(&view->first[vacc], &expected, i + 1, 0,
+            __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+
+/** Record at a position of a log
+ * @param chunks   chunk list of the log
+ * @param pos   position of the record
+ * @return  the record
+ */
+static LogEntry *log_entry(LogEntry **chunks, int pos) {
+    return &chunks[pos >> LOGBITS][pos & (LOGCHUNK - 1)];
+}
+
+
+/** Finds the slot of a user in a table of a log
+ * @param table   table of users
+ * @param name   name of the user
+ * @param hash   hash_user() of name
+ * @details Safe for readers: a slot is filled before its name is set
+ * @return  slot holding the user, or the empty slot where it would go
+ */
+static LogUser *find_log_user(LogTable *table, const char *name,
+    unsigned int hash) {
+    int mask = table->size - 1;
+
+    for (int pos = hash & mask; ; pos = (pos + 1) & mask) {
+        LogUser *user = &table->users[pos];
+        const char *user_name = __atomic_load_n(&user->name,
+            __ATOMIC_ACQUIRE);
+        if (user_name == NULL ||
+            (user->hash == hash && strcmp(user_name, name) == 0)) {
+            return user;
+        }
+    }
+}
+
+
+/** Replaces the table of users of a log by one twice as big
+ * @param engine   engine structure
+ * @param shard   shard of the log, locked
+ */
+static void grow_log_table(Engine *engine, Shard *shard) {
+    LogTable *old = shard->log.table, *table = malloc(sizeof(LogTable));
+
+    check_allocation(table, engine->idiom);
+    table->size = old != NULL ? old->size * 2 : 64;
+    table->users = calloc(table->size, sizeof(LogUser));
+    check_allocation(table->users, engine->idiom);
+    for (int i = 0; old != NULL && i < old->size; i++) {
+        if (old->users[i].name != NULL) {
+            *find_log_user(table, old->users[i].name, old->users[i].hash) =
+                old->users[i];
+        }
+    }
+    __atomic_store_n(&shard->log.table, table, __ATOMIC_SEQ_CST);
+    if (old != NULL) {
+        retire(&engine->epochs, &shard->retired, old, free_table);
+    }
+}
+
+
+/** Makes room in a log for one more record
+ * @param engine   engine structure
+ * @param shard   shard of the log, locked
+ * @details A full chunk list is replaced by a bigger copy; the chunks
+themselves never move
+ */
+static void grow_log(Engine *engine, Shard *shard) {
+    RecordLog *log = &shard->log;
+    LogEntry *chunk;
+
+    if (log->num_chunks == log->chunk_cap) {
+        LogEntry **old = log->chunks, **chunks;
+        int cap = grow_capacity(log->chunk_cap, INOCULAGROWTH);
+        chunks = malloc(sizeof(LogEntry *) * cap);
+        check_allocation(chunks, engine->idiom);
+        if (old != NULL) {
+            memcpy(chunks, old, sizeof(LogEntry *) * log->num_chunks);
+        }
+        __atomic_store_n(&log->chunks, chunks, __ATOMIC_SEQ_CST);
+        log->chunk_cap = cap;
+        if (old != NULL) {
+            retire(&engine->epochs, &shard->retired, old, free);
+        }
+    }
+    chunk = malloc(sizeof(LogEntry) * LOGCHUNK);
+    check_allocation(chunk, engine->idiom);
+    log->chunks[log->num_chunks++] = chunk;
+}
+
+
+/** Appends a record to the log of its shard and publishes it
+ * @param engine   engine structure
+ * @param shard   shard of the user, locked
+ * @param info   the record, with names that stay valid with the engine
+ * @details The record and its links are written before the length, so a
+reader that sees the new length sees all of it
+ */
+static void append_record(Engine *engine, Shard *shard,
+    const RecordInfo *info) {
+    RecordLog *log = &shard->log;
+    unsigned int hash = hash_user(info->user_name);
+    int pos = log->len;
+    LogEntry *entry;
+    LogUser *user;
+
+    if (pos == log->num_chunks * LOGCHUNK) {
+        grow_log(engine, shard);
+    }
+    entry = log_entry(log->chunks, pos);
+    entry->info = *info;
+    entry->next = NIL;
+
+    if (2 * (log->num_users + 1) > (log->table ? log->table->size : 0)) {
+        grow_log_table(engine, shard);
+    }
+    user = find_log_user(log->table, info->user_name, hash);
+    if (user->name == NULL) { /* first record of the user */
+        user->hash = hash;
+        user->head = user->tail = pos;
+        __atomic_store_n(&user->name, info->user_name, __ATOMIC_RELEASE);
+        log->num_users++;
+    } else {
+        __atomic_store_n(&log_entry(log->chunks, user->tail)->next, pos,
+            __ATOMIC_RELEASE);
+        user->tail = pos;
+    }
+    __atomic_store_n(&log->len, pos + 1, __ATOMIC_RELEASE);
+}
+
+
+/** Administers a dose of a vaccine to a user, as administer()
+ * @param engine   engine structure
+ * @param user_name   name of the user
+ * @param vacc_name   name of the vaccine (any case)
+ * @param batch_name   receives the name of the batch used (NULL to ignore)
+ * @details Safe to call from any number of threads at once. Calls for
+users of different shards only share the dose claims
+ * @return  ERRNONE, ERRALRVACC or ERRNOSTOCK
+ */
+int engine_administer(Engine *engine, const char *user_name,
+    const char *vacc_name, const char **batch_name) {
+    Shard *shard = &engine->shards[hash_user(user_name) % engine->num_shards];
+    Sys *sys = &shard->sys;
+    int error = ERRNONE;
+    ViewRow *row;
+
+    pthread_rwlock_rdlock(&engine->lock);
+    pthread_mutex_lock(&shard->lock);
+    if (is_already_vaccinated(sys, user_name, vacc_name)) {
+        error = ERRALRVACC;
+    } else if ((row = claim_dose(engine, engine->view, vacc_name)) == NULL) {
+        error = ERRNOSTOCK;
+    } else {
+        Inocula key; /* only the dose set keeps it */
+        RecordInfo info;
+        key.user_id = intern(&sys->names, user_name);
+        key.vacc_id = intern(&sys->names, vacc_name);
+        key.ap_date = sys->today;
+        add_dose_key(sys, &key);
+        info.user_name = name_of(&sys->names, key.user_id);
+        info.vacc_name = name_of(&sys->names, key.vacc_id);
+        info.batch_name = row->info.batch_name;
+        info.ap_date = sys->today;
+        append_record(engine, shard, &info);
+        if (batch_name != NULL) {
+            *batch_name = row->info.batch_name;
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+    pthread_rwlock_unlock(&engine->lock);
+    return error;
+}
+
+
+/** Lists batches by expiration date, then name, as list_batches()
+ * @param engine   engine structure
+ * @param vacc_name   only batches of this vaccine, exact case (NULL for all)
+ * @param visit   called with each batch, returns nonzero to stop
+ * @param ctx   argument of visit
+ * @details Takes no lock. The batches are those of one version of the
+catalog; each batch's doses and applications are read in one atomic load,
+so they always add up
+ * @return  ERRNONE, or ERRNOSVACC if a vaccine was given and has no batches
+ */
+int engine_list_batches(Engine *engine, const char *vacc_name,
+    int (*visit)(const BatchInfo *, void *), void *ctx) {
+    int slot = enter_epoch(&engine->epochs), found = 0;
+    View *view = __atomic_load_n(&engine->view, __ATOMIC_SEQ_CST);
+
+    for (int i = 0; i < view->num_rows; i++) {
+        ViewRow *row = &view->rows[i];
+        BatchInfo info;
+
+        if (vacc_name != NULL && strcmp(row->info.vacc_name, vacc_name) != 0) {
+            continue;
+        }
+        info.batch_name = row->info.batch_name;
+        info.vacc_name = row->info.vacc_name;
+        info.exp_date = row->info.exp_date;
+        info.doses = __atomic_load_n(&row->info.doses, __ATOMIC_ACQUIRE);
+        info.num_app = row->total - info.doses;
+        found++;
+        if (visit(&info, ctx)) {
+            break;
+        }
+    }
+    exit_epoch(&engine->epochs, slot);
+    return vacc_name != NULL && found == 0 ? ERRNOSVACC : ERRNONE;
+}
+
+
+/** Lists every record, merging the shards by application date
+ * @param engine   engine structure, inside an epoch
+ * @param visit   called with each record, returns nonzero to stop
+ * @param ctx   argument of visit
+ */
+static void list_all_records(Engine *engine,
+    int (*visit)(const RecordInfo *, void *), void *ctx) {
+    int *len = malloc(sizeof(int) * engine->num_shards);
+    int *next = calloc(engine->num_shards, sizeof(int));
+    LogEntry ***chunks = malloc(sizeof(LogEntry **) * engine->num_shards);
+
+    check_allocation(len, engine->idiom);
+    check_allocation(next, engine->idiom);
+    check_allocation(chunks, engine->idiom);
+    for (int s = 0; s < engine->num_shards; s++) {
+        RecordLog *log = &engine->shards[s].log;
+        len[s] = __atomic_load_n(&log->len, __ATOMIC_ACQUIRE);
+        chunks[s] = __atomic_load_n(&log->chunks, __ATOMIC_SEQ_CST);
+    }
+    for (;;) {
+        const RecordInfo *first = NULL;
+        int from = NIL;
+        for (int s = 0; s < engine->num_shards; s++) {
+            const RecordInfo *info;
+            if (next[s] == len[s]) {
+                continue;
+            }
+            info = &log_entry(chunks[s], next[s])->info;
+            if (first == NULL || info->ap_date < first->ap_date) {
+                first = info;
+                from = s;
+            }
+        }
+        if (first == NULL || visit(first, ctx)) {
+            break;
+        }
+        next[from]++;
+    }
+    free(len);
+    free(next);
+    free(chunks);
+}
+
+
+/** Lists vaccination records by application date, as list_records()
+ * @param engine   engine structure
+ * @param user_name   only records of this user (NULL for all)
+ * @param visit   called with each record, returns nonzero to stop
+ * @param ctx   argument of visit
+ * @details Takes no lock. Each shard is read as the prefix of its log
+published when the listing started
+ * @return  ERRNONE, or ERRNOSUSER if a user was given and has no records
+ */
+int engine_list_records(Engine *engine, const char *user_name,
+    int (*visit)(const RecordInfo *, void *), void *ctx) {
+    int slot = enter_epoch(&engine->epochs), error = ERRNOSUSER;
+    Shard *shard;
+    LogTable *table;
+    LogEntry **chunks;
+    int len, pos;
+
+    if (user_name == NULL) {
+        list_all_records(engine, visit, ctx);
+        exit_epoch(&engine->epochs, slot);
+        return ERRNONE;
+    }
+    shard = &engine->shards[hash_user(user_name) % engine->num_shards];
+    len = __atomic_load_n(&shard->log.len, __ATOMIC_ACQUIRE);
+    table = __atomic_load_n(&shard->log.table, __ATOMIC_SEQ_CST);
+    chunks = __atomic_load_n(&shard->log.chunks, __ATOMIC_SEQ_CST);
+    if (table != NULL && len > 0) {
+        LogUser *user = find_log_user(table, user_name, hash_user(user_name));
+        pos = __atomic_load_n(&user->name, __ATOMIC_ACQUIRE) != NULL ?
+            user->head : NIL;
+        /* the user's records, up to the length read above */
+        while (pos != NIL && pos < len) {
+            LogEntry *entry = log_entry(chunks, pos);
+            error = ERRNONE;
+            if (visit(&entry->info, ctx)) {
+                break;
+            }
+            pos = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE);
+        }
+    }
+    exit_epoch(&engine->epochs, slot);
+    return error;
+}
@@ -0,0 +1,390 @@
+/**
+ * Vaccination Management System - Snapshots
+ * @brief: This file contains the binary snapshot of the system state:
+ * - Saving batches, inoculations, their indexes and the names to a file
+ * - Loading a snapshot by mapping it in memory, so the arrays are used
+ * where they lie in the file and only touched pages are read
+ * @file: snapshot.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "project.h"
+
+/** sections of a snapshot, in file order */
+enum {
+    SNAP_BATCHES,       /**< batch slots */
+    SNAP_VACCINES,      /**< vaccines, in registration order */
+    SNAP_INOCULA,       /**< inoculations, padded to whole chunks */
+    SNAP_DOSES,     /**< dose set */
+    SNAP_USERS,     /**< user index */
+    SNAP_OFFSETS,       /**< position of each name in the pool */
+    SNAP_HASHES,        /**< hash of each name */
+    SNAP_POOL,      /**< the names */
+    SNAP_TABLE,     /**< hash table of names */
+    SNAPSECTIONS
+};
+
+
+/** vaccine as stored in a snapshot; its stock is rebuilt from the batches */
+typedef struct {
+    long long applied;      /**< doses applied from all its batches */
+    int name_id;        /**< ID of name of vaccine (as first registered) */
+    int unused;     /**< keeps the size free of padding */
+} SnapVaccine;
+
+
+/** first bytes of a snapshot file */
+typedef struct {
+    char magic[8];      /**< SNAPMAGIC */
+    int version;        /**< SNAPVERSION */
+    int byte_order;     /**< SNAPORDER, as stored by the saving machine */
+    int layout[6];      /**< sizes of the stored types and CHUNKSIZE */
+    Date today;     /**< current date */
+    int num_batch, top_batch, free_batch, batch_root;       /**< batches */
+    int num_vacc;       /**< vaccines */
+    int num_inocula, num_dead;      /**< inoculations */
+    int dose_set_size, dose_set_used, dose_set_live;        /**< dose set */
+    int user_capacity;      /**< user index */
+    int num_names, pool_len, table_size;        /**< names */
+    long long offset[SNAPSECTIONS];     /**< file position of each section */
+    long long length[SNAPSECTIONS];     /**< bytes in each section */
+    long long size;     /**< size of the file */
+    long long lsn;      /**< journal records included */
+    Expiry last_expiry, total_expiry;       /**< batches retired */
+} SnapHeader;
+
+
+/** Fills in the sizes that must match between saving and loading
+ * @param layout   receives the sizes
+ */
+static void set_layout(int layout[6]) {
+    layout[0] = sizeof(Date);
+    layout[1] = sizeof(Batch);
+    layout[2] = sizeof(InoculaChunk);
+    layout[3] = sizeof(DoseKey);
+    layout[4] = sizeof(User);
+    layout[5] = CHUNKSIZE;
+}
+
+
+/** Rounds a file position up to the section alignment
+ * @param pos   file position
+ * @return  aligned position
+ */
+static long long align_offset(long long pos) {
+    return (pos + SNAPALIGN - 1) / SNAPALIGN * SNAPALIGN;
+}
+
+
+/** Writes zeros up to a file position
+ * @param file   snapshot file
+ * @param pos   current position, updated
+ * @param target   position to reach
+ * @return  0 if written, 1 on error
+ */
+static int write_padding(FILE *file, long long *pos, long long target) {
+    static const char zeros[SNAPALIGN];
+
+    while (*pos < target) {
+        long long n = target - *pos < SNAPALIGN ? target - *pos : SNAPALIGN;
+        if (fwrite(zeros, 1, n, file) != (size_t)n) {
+            return 1;
+        }
+        *pos += n;
+    }
+    return 0;
+}
+
+
+/** Writes bytes at the current file position
+ * @param file   snapshot file
+ * @param pos   current position, updated
+ * @param data   bytes to write
+ * @param len   number of bytes
+ * @return  0 if written, 1 on error
+ */
+static int write_data(FILE *file, long long *pos, const void *data,
+    size_t len) {
+    if (len > 0 && fwrite(data, 1, len, file) != len) {
+        return 1;
+    }
+    *pos += len;
+    return 0;
+}
+
+
+/** Describes the current system state in a snapshot header
+ * @param sys   system structure
+ * @param head   receives the header, with the section positions
+ */
+static void set_header(Sys *sys, SnapHeader *head) {
+    long long pos = sizeof(SnapHeader);
+    int num_chunks = (sys->num_inocula + CHUNKSIZE - 1) / CHUNKSIZE;
+
+    memset(head, 0, sizeof(SnapHeader));
+    memcpy(head->magic, SNAPMAGIC, sizeof(head->magic));
+    head->version = SNAPVERSION;
+    head->byte_order = SNAPORDER;
+    set_layout(head->layout);
+    head->today = sys->today;
+    head->lsn = sys->lsn;
+    head->last_expiry = sys->last_expiry;
+    head->total_expiry = sys->total_expiry;
+    head->num_batch = sys->num_batch;
+    head->num_vacc = sys->num_vacc;
+    head->top_batch = sys->top_batch;
+    head->free_batch = sys->free_batch;
+    head->batch_root = sys->batch_root;
+    head->num_inocula = sys->num_inocula;
+    head->num_dead = sys->num_dead;
+    head->dose_set_size = sys->dose_set_size;
+    head->dose_set_used = sys->dose_set_used;
+    head->dose_set_live = sys->dose_set_live;
+    head->user_capacity = sys->user_capacity;
+    head->num_names = sys->names.num_names;
+    head->pool_len = sys->names.pool_len;
+    head->table_size = sys->names.table_size;
+
+    head->length[SNAP_BATCHES] = (long long)sizeof(Batch) * sys->top_batch;
+    head->length[SNAP_VACCINES] = (long long)sizeof(SnapVaccine) *
+        sys->num_vacc;
+    head->length[SNAP_INOCULA] = (long long)sizeof(InoculaChunk) *
+        num_chunks;
+    head->length[SNAP_DOSES] = (long long)sizeof(DoseKey) *
+        sys->dose_set_size;
+    head->length[SNAP_USERS] = (long long)sizeof(User) * sys->user_capacity;
+    head->length[SNAP_OFFSETS] = (long long)sizeof(int) * head->num_names;
+    head->length[SNAP_HASHES] = (long long)sizeof(unsigned int) *
+        head->num_names;
+    head->length[SNAP_POOL] = head->pool_len;
+    head->length[SNAP_TABLE] = (long long)sizeof(int) * head->table_size;
+
+    /* every section starts on its own page */
+    for (int i = 0; i < SNAPSECTIONS; i++) {
+        head->offset[i] = align_offset(pos);
+        pos = head->offset[i] + head->length[i];
+    }
+    head->size = pos;
+}
+
+
+/** Saves the system state to a snapshot file
+ * @param sys   system structure
+ * @param path   path of the snapshot
+ * @details Writes to a temporary file renamed over path once complete, so
+a crash never leaves a partial snapshot behind
+ * @return  0 if saved, 1 on error
+ */
+int save_snapshot(Sys *sys, const char *path) {
+    SnapHeader head;
+    char *tmp = malloc(strlen(path) + 5);
+    long long pos = 0;
+    int error = 0;
+    FILE *file;
+
+    check_allocation(tmp, sys->batch_arena.idiom);
+    sprintf(tmp, "%s.tmp", path);
+    if ((file = fopen(tmp, "wb")) == NULL) {
+        free(tmp);
+        return 1;
+    }
+    set_header(sys, &head);
+    error |= write_data(file, &pos, &head, sizeof(head));
+
+    error |= write_padding(file, &pos, head.offset[SNAP_BATCHES]);
+    error |= write_data(file, &pos, sys->batches,
+        head.length[SNAP_BATCHES]);
+    error |= write_padding(file, &pos, head.offset[SNAP_VACCINES]);
+    for (int v = 0; v < sys->num_vacc; v++) {
+        SnapVaccine vaccine = {sys->vaccines[v].applied,
+            sys->vaccines[v].name_id, 0};
+        error |= write_data(file, &pos, &vaccine, sizeof(vaccine));
+    }
+
+    /* whole chunks, as each column runs the length of its chunk */
+    error |= write_padding(file, &pos, head.offset[SNAP_INOCULA]);
+    for (int c = 0; c * CHUNKSIZE < sys->num_inocula; c++) {
+        error |= write_data(file, &pos, sys->chunks[c], sizeof(InoculaChunk));
+    }
+
+    error |= write_padding(file, &pos, head.offset[SNAP_DOSES]);
+    error |= write_data(file, &pos, sys->dose_set, head.length[SNAP_DOSES]);
+    error |= write_padding(file, &pos, head.offset[SNAP_USERS]);
+    error |= write_data(file, &pos, sys->users, head.length[SNAP_USERS]);
+    error |= write_padding(file, &pos, head.offset[SNAP_OFFSETS]);
+    error |= write_data(file, &pos, sys->names.offset,
+        head.length[SNAP_OFFSETS]);
+    error |= write_padding(file, &pos, head.offset[SNAP_HASHES]);
+    error |= write_data(file, &pos, sys->names.hash,
+        head.length[SNAP_HASHES]);
+    error |= write_padding(file, &pos, head.offset[SNAP_POOL]);
+    error |= write_data(file, &pos, sys->names.pool, head.length[SNAP_POOL]);
+    error |= write_padding(file, &pos, head.offset[SNAP_TABLE]);
+    error |= write_data(file, &pos, sys->names.table,
+        head.length[SNAP_TABLE]);
+
+    error |= fflush(file) != 0 || fsync(fileno(file)) != 0;
+    error |= fclose(file) != 0;
+    if (error || rename(tmp, path) != 0) {
+        remove(tmp);
+        error = 1;
+    }
+    free(tmp);
+    return error;
+}
+
+
+/** Checks that a snapshot header can be loaded by this program
+ * @param head   header read from the file
+ * @param size   size of the file
+ * @return  0 if valid, 1 otherwise
+ */
+static int validate_header(const SnapHeader *head, long long size) {
+    int layout[6];
+
+    set_layout(layout);
+    if (memcmp(head->magic, SNAPMAGIC, sizeof(head->magic)) != 0 ||
+        head->version != SNAPVERSION || head->byte_order != SNAPORDER ||
+        memcmp(head->layout, layout, sizeof(layout)) != 0 ||
+        head->size != size) {
+        return 1;
+    }
+    for (int i = 0; i < SNAPSECTIONS; i++) {
+        if (head->offset[i] < (long long)sizeof(SnapHeader) ||
+            head->length[i] < 0 ||
+            head->offset[i] + head->length[i] > size) {
+            return 1;
+        }
+    }
+    /* the sections must hold what the counters say */
+    return head->length[SNAP_BATCHES] !=
+            (long long)sizeof(Batch) * head->top_batch ||
+        head->length[SNAP_VACCINES] !=
+            (long long)sizeof(SnapVaccine) * head->num_vacc ||
+        head->length[SNAP_INOCULA] < (long long)sizeof(InoculaChunk) *
+            ((head->num_inocula + CHUNKSIZE - 1) / CHUNKSIZE) ||
+        head->length[SNAP_DOSES] !=
+            (long long)sizeof(DoseKey) * head->dose_set_size ||
+        head->length[SNAP_USERS] !=
+            (long long)sizeof(User) * head->user_capacity ||
+        head->length[SNAP_OFFSETS] != (long long)sizeof(int) * head->num_names ||
+        head->length[SNAP_HASHES] !=
+            (long long)sizeof(unsigned int) * head->num_names ||
+        head->length[SNAP_POOL] != head->pool_len ||
+        head->length[SNAP_TABLE] != (long long)sizeof(int) * head->table_size;
+}
+
+
+/** Registers the saved vaccines again and rebuilds their stock
+ * @param sys   system structure
+ * @param vaccines   saved vaccines, in registration order
+ * @param num_vacc   number of saved vaccines
+ * @details Vaccines keep their index and applied doses even when none of
+their batches is left; only the heaps come from the loaded batches
+ */
+static void rebuild_stock(Sys *sys, const SnapVaccine *vaccines,
+    int num_vacc) {
+    for (int v = 0; v < num_vacc; v++) {
+        int vacc = add_vaccine(sys, vaccines[v].name_id);
+        sys->vaccines[vacc].applied = vaccines[v].applied;
+    }
+    for (int i = 0; i < sys->top_batch; i++) {
+        Batch *batch = &sys->batches[i];
+        if (batch->batch_id != NIL) { /* skip free slots */
+            batch->heap_pos = NIL;
+            batch->vacc = add_vaccine(sys, batch->vacc_id);
+            push_stock(sys, i);
+        }
+    }
+}
+
+
+/** Loads a snapshot into a freshly set up system
+ * @param sys   system structure, as left by set_system()
+ * @param path   path of the snapshot
+ * @details The file is mapped privately: the arrays stay in the mapping,
+pages are read when first touched and copied when first changed. Only the
+vaccine stock is rebuilt
+ * @return  0 if loaded, 1 if the file cannot be opened, 2 if it is not a
+valid snapshot
+ */
+int load_snapshot(Sys *sys, const char *path) {
+    struct stat st;
+    SnapHeader head;
+    char *map;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return 1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapHeader)) {
+        close(fd);
+        return 2;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 2;
+    }
+    memcpy(&head, map, sizeof(head));
+    if (validate_header(&head, st.st_size)) {
+        munmap(map, st.st_size);
+        return 2;
+    }
+    sys->snap_map = map;
+    sys->snap_size = st.st_size;
+    sys->today = head.today;
+    sys->lsn = head.lsn;
+    sys->last_expiry = head.last_expiry;
+    sys->total_expiry = head.total_expiry;
+
+    /* names */
+    sys->names.num_names = sys->names.names_cap = head.num_names;
+    sys->names.offset = (int *)(map + head.offset[SNAP_OFFSETS]);
+    sys->names.hash = (unsigned int *)(map + head.offset[SNAP_HASHES]);
+    sys->names.pool_len = sys->names.pool_cap = head.pool_len;
+    sys->names.pool = map + head.offset[SNAP_POOL];
+    sys->names.table_size = head.table_size;
+    sys->names.table = (int *)(map + head.offset[SNAP_TABLE]);
+
+    /* batches, whose stock needs the names */
+    sys->batches = (Batch *)(map + head.offset[SNAP_BATCHES]);
+    sys->batch_capacity = head.top_batch;
+    sys->num_batch = head.num_batch;
+    sys->top_batch = head.top_batch;
+    sys->free_batch = head.free_batch;
+    sys->batch_root = head.batch_root;
+    rebuild_stock(sys, (const SnapVaccine *)(map +
+        head.offset[SNAP_VACCINES]), head.num_vacc);
+
+    /* inoculations, one chunk of the mapping after the other */
+    sys->num_inocula = head.num_inocula;
+    sys->num_dead = head.num_dead;
+    sys->num_chunks = head.length[SNAP_INOCULA] /
+        (long long)sizeof(InoculaChunk);
+    sys->chunk_capacity = sys->num_chunks;
+    sys->chunks = arena_alloc(&sys->record_arena,
+        sizeof(InoculaChunk *) * sys->num_chunks);
+    for (int c = 0; c < sys->num_chunks; c++) {
+        sys->chunks[c] = (InoculaChunk *)(map + head.offset[SNAP_INOCULA]) +
+            c;
+    }
+
+    /* indexes */
+    sys->dose_set = (DoseKey *)(map + head.offset[SNAP_DOSES]);
+    sys->dose_set_size = head.dose_set_size;
+    sys->dose_set_used = head.dose_set_used;
+    sys->dose_set_live = head.dose_set_live;
+    sys->dose_spare = NULL;
+    sys->users = (User *)(map + head.offset[SNAP_USERS]);
+    sys->user_capacity = head.user_capacity;
+
+    return 0;
+}
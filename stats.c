@@ -0,0 +1,188 @@
+/**
+ * Vaccination Management System - Command Statistics
+ * @brief: This file contains the optional instrumentation of commands:
+ * - Calls, latency histograms, arena bytes and array resizes per command
+ * - Log-linear (HDR-style) histograms: STATSUBBITS bits of precision
+ * across every power of two, so percentiles are within 1/16 of the value
+ * - The report printed by the 's' command
+ * @file: stats.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "project.h"
+
+#define NUMSTATS ((int)sizeof(STATCOMMANDS) - 1)
+
+/** counters of one command */
+typedef struct {
+    long long calls;        /**< times it ran */
+    long long total_ns;     /**< sum of its latencies */
+    long long max_ns;       /**< worst latency */
+    long long bytes;        /**< arena bytes it allocated */
+    long long resizes;      /**< arrays it grew */
+    long long hist[STATBUCKETS];        /**< calls per latency bucket */
+} CommandStats;
+
+static int stats_on;        /**< 1 while commands are being measured */
+static CommandStats stats[NUMSTATS];        /**< in STATCOMMANDS order */
+
+
+/** Current time, in nanoseconds
+ * @return  nanoseconds on a monotonic clock
+ */
+static long long now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/** Turns the measuring of commands on or off
+ * @param enable   1 to measure, 0 to stop
+ */
+void enable_stats(int enable) {
+    stats_on = enable;
+}
+
+
+/** Checks if commands are being measured
+ * @return  1 if they are, 0 otherwise
+ */
+int stats_enabled(void) {
+    return stats_on;
+}
+
+
+/** Histogram bucket of a latency
+ * @param ns   latency, in nanoseconds
+ * @details Values below 2^(STATSUBBITS+1) get a bucket each; above that,
+every doubling is split in 2^STATSUBBITS buckets of equal width
+ * @return  bucket index
+ */
+static int bucket_of(long long ns) {
+    int shift = 0;
+
+    if (ns >= 1LL << STATMAXBITS) {
+        return STATBUCKETS - 1;
+    }
+    while ((ns >> shift) >= 2 << STATSUBBITS) {
+        shift++;
+    }
+    return (shift << STATSUBBITS) + (int)(ns >> shift);
+}
+
+
+/** Lowest latency of a histogram bucket
+ * @param bucket   bucket index
+ * @return  latency, in nanoseconds
+ */
+static long long bucket_low(int bucket) {
+    int shift = (bucket >> STATSUBBITS) - 1;
+
+    if (shift <= 0) {
+        return bucket;
+    }
+    return (long long)((bucket & ((1 << STATSUBBITS) - 1)) |
+        (1 << STATSUBBITS)) << shift;
+}
+
+
+/** Records the state of the system before a command runs
+ * @param sys   system structure
+ * @param probe   receives the state
+ */
+void start_probe(Sys *sys, Probe *probe) {
+    probe->bytes = sys->batch_arena.bytes + sys->record_arena.bytes;
+    probe->resizes = sys->batch_arena.resizes + sys->record_arena.resizes;
+    probe->start_ns = now_ns();
+}
+
+
+/** Adds a command that just ran to its counters
+ * @param sys   system structure
+ * @param command   command letter (not measured if not in STATCOMMANDS)
+ * @param probe   state recorded by start_probe()
+ */
+void end_probe(Sys *sys, char command, const Probe *probe) {
+    long long ns = now_ns() - probe->start_ns;
+    const char *found = command != '\0' ? strchr(STATCOMMANDS, command) :
+        NULL;
+    CommandStats *stat;
+
+    if (found == NULL) {
+        return;
+    }
+    stat = &stats[found - STATCOMMANDS];
+    stat->calls++;
+    stat->total_ns += ns;
+    if (ns > stat->max_ns) {
+        stat->max_ns = ns;
+    }
+    stat->bytes += sys->batch_arena.bytes + sys->record_arena.bytes -
+        probe->bytes;
+    stat->resizes += sys->batch_arena.resizes + sys->record_arena.resizes -
+        probe->resizes;
+    stat->hist[bucket_of(ns)]++;
+}
+
+
+/** Returns a percentile of a command's latencies
+ * @param stat   counters of the command
+ * @param permille   percentile, in thousandths
+ * @return  highest latency of the bucket holding it, in nanoseconds
+ */
+static long long percentile(const CommandStats *stat, int permille) {
+    long long rank = (stat->calls * permille + 999) / 1000, seen = 0;
+
+    for (int i = 0; i < STATBUCKETS - 1; i++) {
+        seen += stat->hist[i];
+        if (seen >= rank) {
+            long long high = bucket_low(i + 1) - 1;
+            return high < stat->max_ns ? high : stat->max_ns;
+        }
+    }
+    return stat->max_ns;
+}
+
+
+/** Appends a named counter to the output, like printf(" %s %lld")
+ * @param name   name of the counter
+ * @param value   value of the counter
+ */
+static void write_counter(const char *name, long long value) {
+    write_char(' ');
+    write_str(name);
+    write_char(' ');
+    write_long(value);
+}
+
+
+/** Prints the counters of every command that ran, one line each
+ * @details Latencies are in nanoseconds; bytes and resizes are those of
+both arenas while the command ran
+ */
+void print_stats(void) {
+    for (int i = 0; i < NUMSTATS; i++) {
+        const CommandStats *stat = &stats[i];
+
+        if (stat->calls == 0) {
+            continue;
+        }
+        write_char(STATCOMMANDS[i]);
+        write_counter("calls", stat->calls);
+        write_counter("mean", stat->total_ns / stat->calls);
+        write_counter("p50", percentile(stat, 500));
+        write_counter("p90", percentile(stat, 900));
+        write_counter("p99", percentile(stat, 990));
+        write_counter("p999", percentile(stat, 999));
+        write_counter("max", stat->max_ns);
+        write_counter("bytes", stat->bytes);
+        write_counter("resizes", stat->resizes);
+        write_char('\n');
+    }
+}
@@ -0,0 +1,353 @@
+/**
+ * Vaccination Management System - Vaccine Stock
+ * @brief: This file contains the per-vaccine dose allocation index:
+ * - Case-insensitive hash table of vaccines
+ * - Min-heap of the non-empty, unexpired batches of each vaccine, in
+ *   ord_batches() order (first expiring, first out)
+ * - Retirement of the batches that expire as the date moves forward
+ * - Running totals of each vaccine (doses in stock, doses applied), kept
+ *   as batches enter and leave the stock, so reading them is O(1)
+ * @file: stock.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "project.h"
+
+/** Hashes a vaccine name ignoring case (djb2)
+ * @param name   name of the vaccine
+ * @return  hash value
+ */
+static unsigned int hash_vacc_name(const char *name) {
+    unsigned int hash = 5381;
+
+    for (; *name != '\0'; name++) {
+        hash = hash * 33 + (unsigned char)tolower((unsigned char)*name);
+    }
+    return hash;
+}
+
+
+/** Finds the table position of a vaccine name
+ * @param sys   system structure
+ * @param name   name of the vaccine
+ * @return  position holding the vaccine, or the empty position where it
+would be inserted
+ */
+static int vacc_table_position(Sys *sys, const char *name) {
+    int mask = sys->vacc_table_size - 1;
+    int pos = hash_vacc_name(name) & mask;
+
+    /* linear probing */
+    while (sys->vacc_table[pos] != NIL &&
+        strcasecmp(name_of(&sys->names,
+        sys->vaccines[sys->vacc_table[pos]].name_id), name) != 0) {
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+
+/** Doubles the vaccine hash table and reinserts every vaccine
+ * @param sys   system structure
+ */
+static void grow_vacc_table(Sys *sys) {
+    sys->vacc_table_size = sys->vacc_table_size ?
+        sys->vacc_table_size * 2 : 16;
+    sys->vacc_table = arena_alloc(&sys->batch_arena,
+        sizeof(int) * sys->vacc_table_size);
+
+    for (int i = 0; i < sys->vacc_table_size; i++) {
+        sys->vacc_table[i] = NIL;
+    }
+    for (int i = 0; i < sys->num_vacc; i++) {
+        const char *name = name_of(&sys->names, sys->vaccines[i].name_id);
+        sys->vacc_table[vacc_table_position(sys, name)] = i;
+    }
+}
+
+
+/** Looks up a vaccine ignoring case
+ * @param sys   system structure
+ * @param name   name of the vaccine
+ * @return  index of the vaccine, NIL if never registered
+ */
+int find_vaccine(Sys *sys, const char *name) {
+    if (sys->vacc_table_size == 0) {
+        return NIL;
+    }
+    return sys->vacc_table[vacc_table_position(sys, name)];
+}
+
+
+/** Looks up a vaccine ignoring case, registering it if new
+ * @param sys   system structure
+ * @param vacc_id   ID of name of the vaccine
+ * @return  index of the vaccine
+ */
+int add_vaccine(Sys *sys, int vacc_id) {
+    const char *name = name_of(&sys->names, vacc_id);
+    int pos, vacc = find_vaccine(sys, name);
+
+    if (vacc != NIL) {
+        return vacc;
+    }
+    /* keep the table at most half full */
+    if (2 * (sys->num_vacc + 1) > sys->vacc_table_size) {
+        grow_vacc_table(sys);
+    }
+    if (sys->num_vacc >= sys->vacc_capacity) {
+        int old_capacity = sys->vacc_capacity;
+        sys->vacc_capacity = sys->vacc_capacity ? sys->vacc_capacity * 2 : 10;
+        sys->vaccines = arena_grow(&sys->batch_arena, sys->vaccines,
+            sizeof(Vaccine) * old_capacity,
+            sizeof(Vaccine) * sys->vacc_capacity);
+    }
+    vacc = sys->num_vacc++;
+    sys->vaccines[vacc].name_id = vacc_id;
+    sys->vaccines[vacc].heap = NULL;
+    sys->vaccines[vacc].heap_len = 0;
+    sys->vaccines[vacc].heap_cap = 0;
+    sys->vaccines[vacc].doses = 0;
+    sys->vaccines[vacc].applied = 0;
+
+    pos = vacc_table_position(sys, name);
+    sys->vacc_table[pos] = vacc;
+    return vacc;
+}
+
+
+/** Stores a batch slot at a heap position, keeping its back reference
+ * @param sys   system structure
+ * @param vaccine   vaccine owning the heap
+ * @param pos   heap position
+ * @param slot   batch slot
+ */
+static void heap_set(Sys *sys, Vaccine *vaccine, int pos, int slot) {
+    vaccine->heap[pos] = slot;
+    sys->batches[slot].heap_pos = pos;
+}
+
+
+/** Moves a heap entry up until its parent comes first
+ * @param sys   system structure
+ * @param vaccine   vaccine owning the heap
+ * @param pos   heap position
+ */
+static void sift_up(Sys *sys, Vaccine *vaccine, int pos) {
+    int slot = vaccine->heap[pos];
+
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (ord_batches(sys, &sys->batches[vaccine->heap[parent]],
+            &sys->batches[slot]) <= 0) {
+            break;
+        }
+        heap_set(sys, vaccine, pos, vaccine->heap[parent]);
+        pos = parent;
+    }
+    heap_set(sys, vaccine, pos, slot);
+}
+
+
+/** Moves a heap entry down until it comes before its children
+ * @param sys   system structure
+ * @param vaccine   vaccine owning the heap
+ * @param pos   heap position
+ */
+static void sift_down(Sys *sys, Vaccine *vaccine, int pos) {
+    int slot = vaccine->heap[pos];
+
+    for (;;) {
+        int child = 2 * pos + 1;
+        if (child >= vaccine->heap_len) {
+            break;
+        }
+        /* pick the child that comes first */
+        if (child + 1 < vaccine->heap_len &&
+            ord_batches(sys, &sys->batches[vaccine->heap[child + 1]],
+            &sys->batches[vaccine->heap[child]]) < 0) {
+            child++;
+        }
+        if (ord_batches(sys, &sys->batches[slot],
+            &sys->batches[vaccine->heap[child]]) <= 0) {
+            break;
+        }
+        heap_set(sys, vaccine, pos, vaccine->heap[child]);
+        pos = child;
+    }
+    heap_set(sys, vaccine, pos, slot);
+}
+
+
+/** Adds a batch to the stock of its vaccine if it can supply doses
+ * @param sys   system structure
+ * @param slot   batch slot (vacc already set)
+ */
+void push_stock(Sys *sys, int slot) {
+    Batch *batch = &sys->batches[slot];
+    Vaccine *vaccine = &sys->vaccines[batch->vacc];
+
+    if (batch->doses <= 0 || batch->exp_date < sys->today) {
+        return; /* empty or expired */
+    }
+    if (vaccine->heap_len >= vaccine->heap_cap) {
+        int old_cap = vaccine->heap_cap;
+        vaccine->heap_cap = vaccine->heap_cap ? vaccine->heap_cap * 2 : 4;
+        vaccine->heap = arena_grow(&sys->batch_arena, vaccine->heap,
+            sizeof(int) * old_cap, sizeof(int) * vaccine->heap_cap);
+    }
+    heap_set(sys, vaccine, vaccine->heap_len++, slot);
+    sift_up(sys, vaccine, batch->heap_pos);
+    vaccine->doses += batch->doses;
+}
+
+
+/** Removes a batch from the stock of its vaccine, if it is there
+ * @param sys   system structure
+ * @param slot   batch slot
+ */
+void remove_stock(Sys *sys, int slot) {
+    Batch *batch = &sys->batches[slot];
+    Vaccine *vaccine;
+    int pos = batch->heap_pos;
+
+    if (pos == NIL) {
+        return;
+    }
+    vaccine = &sys->vaccines[batch->vacc];
+    batch->heap_pos = NIL;
+    vaccine->doses -= batch->doses;
+
+    /* fill the hole with the last entry */
+    if (pos != --vaccine->heap_len) {
+        int last = vaccine->heap[vaccine->heap_len];
+        heap_set(sys, vaccine, pos, last);
+        sift_up(sys, vaccine, pos);
+        sift_down(sys, vaccine, sys->batches[last].heap_pos);
+    }
+}
+
+
+/** Retires a batch that expired, if it was still in stock
+ * @param sys   system structure
+ * @param batch   batch structure
+ * @param ctx   Expiry summing the retirements
+ * @return  always 0, to retire every batch of the range
+ */
+static int retire_batch(Sys *sys, Batch *batch, void *ctx) {
+    Expiry *expiry = ctx;
+
+    if (batch->heap_pos != NIL) { /* emptied or removed ones are out */
+        expiry->batches++;
+        expiry->doses += batch->doses;
+        remove_stock(sys, batch - sys->batches);
+    }
+    return 0;
+}
+
+
+/** Retires the batches that expired as the date moved forward
+ * @param sys   system structure, with its new date
+ * @param from   date before the move
+ * @details Only batches expiring from the old date to the day before the
+new one are visited, found in the batch tree by expiration date, so the
+cost follows the batches expiring, not all of them. Their doses stay listed
+ */
+void retire_expired(Sys *sys, Date from) {
+    sys->last_expiry.batches = 0;
+    sys->last_expiry.doses = 0;
+    visit_expiring(sys, sys->batch_root, from, sys->today, retire_batch,
+        &sys->last_expiry);
+    sys->total_expiry.batches += sys->last_expiry.batches;
+    sys->total_expiry.doses += sys->last_expiry.doses;
+}
+
+
+/** Finds the batch a dose of a vaccine must come from
+ * @param sys   system structure
+ * @param vacc_name   name of the vaccine (any case)
+ * @details Batches that expired since they were stocked are dropped on the
+way, as time never goes back
+ * @return  first expiring batch with doses, NULL if there is no stock
+ */
+Batch *next_stock(Sys *sys, const char *vacc_name) {
+    int vacc = find_vaccine(sys, vacc_name);
+    Vaccine *vaccine;
+
+    if (vacc == NIL) {
+        return NULL;
+    }
+    vaccine = &sys->vaccines[vacc];
+    while (vaccine->heap_len > 0) {
+        Batch *batch = &sys->batches[vaccine->heap[0]];
+        if (batch->exp_date >= sys->today) {
+            return batch;
+        }
+        remove_stock(sys, vaccine->heap[0]); /* expired */
+    }
+    return NULL;
+}
+
+
+/** Takes one dose from a batch to apply it, dropping the batch from the
+stock once empty
+ * @param sys   system structure
+ * @param batch   batch returned by next_stock()
+ */
+void take_dose(Sys *sys, Batch *batch) {
+    Vaccine *vaccine = &sys->vaccines[batch->vacc];
+
+    vaccine->doses--;
+    vaccine->applied++;
+    batch->num_app++;
+    if (--batch->doses == 0) {
+        remove_stock(sys, batch - sys->batches);
+    }
+}
+
+
+/** Applies the doses taken from a batch outside the stock index
+ * @param sys   system structure
+ * @param slot   batch slot
+ * @param doses   doses the batch has left, at most those it had
+ * @details Used by the concurrent engine, whose claims only count down a
+copy of the doses
+ */
+void claim_stock(Sys *sys, int slot, int doses) {
+    Batch *batch = &sys->batches[slot];
+    Vaccine *vaccine = &sys->vaccines[batch->vacc];
+    int taken = batch->doses - doses;
+
+    if (batch->heap_pos != NIL) {
+        vaccine->doses -= taken;
+    }
+    vaccine->applied += taken;
+    batch->num_app += taken;
+    batch->doses = doses;
+    if (doses == 0) {
+        remove_stock(sys, slot);
+    }
+}
+
+
+/** Reads the running totals of a vaccine
+ * @param sys   system structure
+ * @param vacc   index of the vaccine
+ * @param stock   receives the totals
+ * @details The first batch of the heap is the first to expire, and expired
+ones already left it, so nothing is walked
+ */
+void read_stock(Sys *sys, int vacc, StockInfo *stock) {
+    Vaccine *vaccine = &sys->vaccines[vacc];
+
+    stock->vacc_name = name_of(&sys->names, vaccine->name_id);
+    stock->doses = vaccine->doses;
+    stock->applied = vaccine->applied;
+    stock->batches = vaccine->heap_len;
+    stock->first_exp = vaccine->heap_len > 0 ?
+        sys->batches[vaccine->heap[0]].exp_date : 0;
+}
@@ -0,0 +1,275 @@
+/**
+ * Vaccination Management System - Batch Tree
+ * @brief: This file contains the ordered index of batches:
+ * - Batch slot allocation and reuse
+ * - AVL tree insertion and removal keyed by ord_batches()
+ * - In-order traversal of the batches
+ * - Lookup of a batch by name
+ * @file: tree.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "project.h"
+
+/** Returns the height of a subtree
+ * @param sys   system structure
+ * @param node   root of the subtree (NIL if empty)
+ * @return  height of the subtree, 0 if empty
+ */
+static int height(Sys *sys, int node) {
+    return node == NIL ? 0 : sys->batches[node].height;
+}
+
+
+/** Recomputes the height of a node from its children
+ * @param sys   system structure
+ * @param node   node to update
+ */
+static void update_height(Sys *sys, int node) {
+    int left = height(sys, sys->batches[node].left);
+    int right = height(sys, sys->batches[node].right);
+    sys->batches[node].height = (left > right ? left : right) + 1;
+}
+
+
+/** Rotates a subtree to the right
+ * @param sys   system structure
+ * @param node   root of the subtree
+ * @return  new root of the subtree
+ */
+static int rotate_right(Sys *sys, int node) {
+    int left = sys->batches[node].left;
+
+    sys->batches[node].left = sys->batches[left].right;
+    sys->batches[left].right = node;
+    update_height(sys, node);
+    update_height(sys, left);
+    return left;
+}
+
+
+/** Rotates a subtree to the left
+ * @param sys   system structure
+ * @param node   root of the subtree
+ * @return  new root of the subtree
+ */
+static int rotate_left(Sys *sys, int node) {
+    int right = sys->batches[node].right;
+
+    sys->batches[node].right = sys->batches[right].left;
+    sys->batches[right].left = node;
+    update_height(sys, node);
+    update_height(sys, right);
+    return right;
+}
+
+
+/** Restores the AVL property on a node after an insertion or removal
+ * @param sys   system structure
+ * @param node   root of the subtree
+ * @return  new root of the subtree
+ */
+static int balance(Sys *sys, int node) {
+    Batch *b = sys->batches;
+    int factor;
+
+    update_height(sys, node);
+    factor = height(sys, b[node].left) - height(sys, b[node].right);
+
+    if (factor > 1) { /* left heavy */
+        if (height(sys, b[b[node].left].left) <
+            height(sys, b[b[node].left].right)) {
+            b[node].left = rotate_left(sys, b[node].left);
+        }
+        return rotate_right(sys, node);
+    }
+    if (factor < -1) { /* right heavy */
+        if (height(sys, b[b[node].right].right) <
+            height(sys, b[b[node].right].left)) {
+            b[node].right = rotate_right(sys, b[node].right);
+        }
+        return rotate_left(sys, node);
+    }
+    return node;
+}
+
+
+/** Inserts a batch slot in the tree
+ * @param sys   system structure
+ * @param node   root of the subtree
+ * @param slot   slot of the batch to insert (fully filled in)
+ * @return  new root of the subtree
+ */
+int insert_batch_node(Sys *sys, int node, int slot) {
+    Batch *b = sys->batches;
+
+    if (node == NIL) {
+        b[slot].left = b[slot].right = NIL;
+        b[slot].height = 1;
+        return slot;
+    }
+    if (ord_batches(sys, &b[slot], &b[node]) < 0) {
+        b[node].left = insert_batch_node(sys, b[node].left, slot);
+    } else {
+        b[node].right = insert_batch_node(sys, b[node].right, slot);
+    }
+    return balance(sys, node);
+}
+
+
+/** Detaches the leftmost node of a subtree
+ * @param sys   system structure
+ * @param node   root of the subtree
+ * @param min   receives the detached node
+ * @return  new root of the subtree
+ */
+static int remove_min_node(Sys *sys, int node, int *min) {
+    if (sys->batches[node].left == NIL) {
+        *min = node;
+        return sys->batches[node].right;
+    }
+    sys->batches[node].left = remove_min_node(sys, sys->batches[node].left,
+        min);
+    return balance(sys, node);
+}
+
+
+/** Removes a batch slot from the tree
+ * @param sys   system structure
+ * @param node   root of the subtree
+ * @param slot   slot of the batch to remove (still holding its key)
+ * @return  new root of the subtree
+ */
+int remove_batch_node(Sys *sys, int node, int slot) {
+    Batch *b = sys->batches;
+    int cmp, min;
+
+    if (node == NIL) {
+        return NIL;
+    }
+    cmp = ord_batches(sys, &b[slot], &b[node]);
+    if (cmp < 0) {
+        b[node].left = remove_batch_node(sys, b[node].left, slot);
+    } else if (cmp > 0) {
+        b[node].right = remove_batch_node(sys, b[node].right, slot);
+    } else { /* batch names are unique, so this is the slot */
+        if (b[node].left == NIL || b[node].right == NIL) {
+            return b[node].left != NIL ? b[node].left : b[node].right;
+        }
+        /* replace the node by its in-order successor */
+        b[node].right = remove_min_node(sys, b[node].right, &min);
+        b[min].left = b[node].left;
+        b[min].right = b[node].right;
+        node = min;
+    }
+    return balance(sys, node);
+}
+
+
+/** Visits the batches of a subtree in (exp_date, batch_name) order
+ * @param sys   system structure
+ * @param node   root of the subtree
+ * @param visit   function called for each batch, nonzero stops the walk
+ * @param ctx   extra argument given to visit
+ * @return  1 if the walk was stopped, 0 otherwise
+ */
+int visit_batches(Sys *sys, int node,
+    int (*visit)(Sys *, Batch *, void *), void *ctx) {
+
+    if (node == NIL) {
+        return 0;
+    }
+    if (visit_batches(sys, sys->batches[node].left, visit, ctx) ||
+        visit(sys, &sys->batches[node], ctx)) {
+        return 1;
+    }
+    return visit_batches(sys, sys->batches[node].right, visit, ctx);
+}
+
+
+/** Visits the batches of a subtree expiring in a date range, in order
+ * @param sys   system structure
+ * @param node   root of the subtree
+ * @param from   first expiration date visited
+ * @param to   expiration dates from this one on are not visited
+ * @param visit   function called for each batch, nonzero stops the walk
+ * @param ctx   extra argument given to visit
+ * @details Subtrees wholly out of the range are skipped, so the walk costs
+the height of the tree plus the batches visited
+ * @return  1 if the walk was stopped, 0 otherwise
+ */
+int visit_expiring(Sys *sys, int node, Date from, Date to,
+    int (*visit)(Sys *, Batch *, void *), void *ctx) {
+    Batch *batch;
+
+    if (node == NIL) {
+        return 0;
+    }
+    batch = &sys->batches[node];
+    if (batch->exp_date >= from && (visit_expiring(sys, batch->left, from,
+        to, visit, ctx) || (batch->exp_date < to && visit(sys, batch, ctx)))) {
+        return 1;
+    }
+    return batch->exp_date < to &&
+        visit_expiring(sys, batch->right, from, to, visit, ctx);
+}
+
+
+/** Finds the slot of a registered batch
+ * @param sys   system structure
+ * @param batch_name   name of the batch
+ * @return  slot of the batch, NIL if there is no such batch
+ */
+int find_batch(Sys *sys, const char *batch_name) {
+    int batch_id = find_name(&sys->names, batch_name);
+
+    if (batch_id == NIL) {
+        return NIL;
+    }
+    /* free slots hold NIL, so they never match */
+    for (int i = 0; i < sys->top_batch; i++) {
+        if (sys->batches[i].batch_id == batch_id) {
+            return i;
+        }
+    }
+    return NIL;
+}
+
+
+/** Hands out a free batch slot, growing the array if needed
+ * @param sys   system structure
+ * @return  index of the slot
+ */
+int new_batch_slot(Sys *sys) {
+    int slot = sys->free_batch;
+
+    if (slot != NIL) { /* reuse a slot from a removed batch */
+        sys->free_batch = sys->batches[slot].left;
+        set_batch_slots(sys->batches, slot, slot + 1);
+        return slot;
+    }
+    /* check if memory capacity needs to be increased */
+    if (sys->top_batch >= sys->batch_capacity) {
+        int old_capacity = sys->batch_capacity;
+        sys->batch_capacity = grow_capacity(sys->batch_capacity,
+            sys->batch_growth);
+        sys->batches = arena_grow(&sys->batch_arena, sys->batches,
+            sizeof(Batch) * old_capacity, sizeof(Batch) * sys->batch_capacity);
+    }
+    set_batch_slots(sys->batches, sys->top_batch, sys->top_batch + 1);
+    return sys->top_batch++;
+}
+
+
+/** Returns a batch slot to the free list
+ * @param sys   system structure
+ * @param slot   slot of a batch already removed from the tree
+ */
+void free_batch_slot(Sys *sys, int slot) {
+    set_batch_slots(sys->batches, slot, slot + 1);
+    sys->batches[slot].left = sys->free_batch; /* chain free slots */
+    sys->free_batch = slot;
+}
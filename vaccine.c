@@ -0,0 +1,531 @@
+/**
+ * Vaccination Management System - Library API (libvaccine)
+ * @brief: This file contains the typed operations of the engine:
+ * - Batch registration and removal, dose administration, record deletion
+ * - Listings through callbacks, vaccine stock totals, advancing the date
+ * - Messages for the result codes, in both languages
+ * Nothing here parses or prints text; every call returns ERRNONE or the
+ * code of the error. The engine is every source file but project.c:
+ * ar rcs libvaccine.a arena.c aux.c epoch.c filter.c import.c index.c
+ * intern.c io.c parse.c shard.c snapshot.c stats.c stock.c tree.c vaccine.c
+ * wal.c
+ * (compiled)
+ * @file: vaccine.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "project.h"
+
+/* messages of the result codes, indexed by code */
+static const char *const messages[] = {"", E2MANYVACC, EDUPBATCH,
+    EINVBATCH, EINVNAME, EINVDATE, EINVQUANT, ENOSVACC, ENOSTOCK, EALRVACC,
+    ENOSBATCH, ENOSUSER};
+
+/* mensagens dos códigos de resultado */
+static const char *const messages_pt[] = {"", E2MANYVACCPT, EDUPBATCHPT,
+    EINVBATCHPT, EINVNAMEPT, EINVDATEPT, EINVQUANTPT, ENOSVACCPT,
+    ENOSTOCKPT, EALRVACCPT, ENOSBATCHPT, ENOSUSERPT};
+
+
+/** Returns the message of a result code
+ * @param error   result code of a library call
+ * @param idiom   language identifier
+ * @return  the message, "" for ERRNONE
+ */
+const char *error_message(int error, int idiom) {
+    return idiom == 0 ? messages[error] : messages_pt[error];
+}
+
+
+/** Registers a new batch
+ * @param sys   system structure
+ * @param batch_name   name of the batch
+ * @param exp_date   expiration date
+ * @param doses   number of doses
+ * @param vacc_name   name of the vaccine
+ * @details Validated by validate_batch_inputs(), in its order
+ * @return  ERRNONE, or the first validation that failed
+ */
+int add_batch(Sys *sys, const char *batch_name, const Date *exp_date,
+    int doses, const char *vacc_name) {
+    int error, slot;
+
+    error = validate_batch_inputs(sys, batch_name, vacc_name, exp_date,
+        doses);
+    if (error != ERRNONE) {
+        return error;
+    }
+    slot = new_batch_slot(sys);
+
+    /* intern the names, each stored once for the whole system */
+    sys->batches[slot].batch_id = intern(&sys->names, batch_name);
+    sys->batches[slot].vacc_id = intern(&sys->names, vacc_name);
+    sys->batches[slot].exp_date = *exp_date;
+    sys->batches[slot].doses = doses;
+
+    /* link it in (exp_date, batch_name) order and stock it */
+    sys->batch_root = insert_batch_node(sys, sys->batch_root, slot);
+    sys->batches[slot].vacc = add_vaccine(sys, sys->batches[slot].vacc_id);
+    push_stock(sys, slot);
+    sys->num_batch++;
+    return ERRNONE;
+}
+
+
+/** Administers a dose of a vaccine to a user
+ * @param sys   system structure
+ * @param user_name   name of the user
+ * @param vacc_name   name of the vaccine (any case)
+ * @param batch_name   receives the name of the batch used (NULL to ignore);
+it stays valid while the system exists
+ * @details A user gets each vaccine at most once a day; the dose comes from
+the first expiring batch with stock
+ * @return  ERRNONE, ERRALRVACC or ERRNOSTOCK
+ */
+int administer(Sys *sys, const char *user_name, const char *vacc_name,
+    const char **batch_name) {
+    Batch *batch;
+
+    if (is_already_vaccinated(sys, user_name, vacc_name)) {
+        return ERRALRVACC;
+    }
+    batch = next_stock(sys, vacc_name);
+    if (batch == NULL) {
+        return ERRNOSTOCK;
+    }
+    expand_inocula_memory(sys);
+    take_dose(sys, batch);
+    create_inocula(sys, batch - sys->batches, user_name, vacc_name);
+    if (batch_name != NULL) {
+        *batch_name = name_of(&sys->names, batch->batch_id);
+    }
+    return ERRNONE;
+}
+
+
+/** Administers a dose of one vaccine to each user of a list
+ * @param sys   system structure
+ * @param vacc_name   name of the vaccine (any case)
+ * @param user_names   names of the users, in order
+ * @param count   number of users
+ * @param batch_names   receives the name of the batch used by each user, or
+NULL for users with no dose (NULL to ignore)
+ * @param errors   receives the result of each user, as administer()
+ * @details Same results as administer() for each user in turn, so a user
+listed twice gets ERRALRVACC the second time. The vaccine is looked up once
+and its batches are used up in one sweep of the FEFO order
+ * @return  number of doses given
+ */
+int administer_many(Sys *sys, const char *vacc_name,
+    const char *const *user_names, int count, const char **batch_names,
+    int *errors) {
+    int vacc_id = find_name(&sys->names, vacc_name), given = 0;
+    Batch *batch = next_stock(sys, vacc_name);
+
+    for (int i = 0; i < count; i++) {
+        int user_id = vacc_id == NIL ? NIL :
+            find_name(&sys->names, user_names[i]);
+        Batch *used = batch;
+
+        if (batch_names != NULL) {
+            batch_names[i] = NULL;
+        }
+        if (user_id != NIL &&
+            has_dose_key(sys, user_id, vacc_id, &sys->today)) {
+            errors[i] = ERRALRVACC;
+            continue;
+        }
+        if (batch == NULL) {
+            errors[i] = ERRNOSTOCK;
+            continue;
+        }
+        expand_inocula_memory(sys);
+        take_dose(sys, batch);
+        if (batch->doses == 0) { /* used up: on to the next to expire */
+            batch = next_stock(sys, vacc_name);
+        }
+        create_inocula(sys, used - sys->batches, user_names[i], vacc_name);
+        if (vacc_id == NIL) { /* interned by now */
+            vacc_id = find_name(&sys->names, vacc_name);
+        }
+        errors[i] = ERRNONE;
+        if (batch_names != NULL) {
+            batch_names[i] = name_of(&sys->names, used->batch_id);
+        }
+        given++;
+    }
+    return given;
+}
+
+
+/** Removes a batch, or only its remaining doses if it was used
+ * @param sys   system structure
+ * @param batch_name   name of the batch
+ * @param applied   receives the doses applied from it (NULL to ignore)
+ * @return  ERRNONE or ERRNOSBATCH
+ */
+int remove_batch(Sys *sys, const char *batch_name, int *applied) {
+    int slot = find_batch(sys, batch_name);
+
+    if (slot == NIL) {
+        return ERRNOSBATCH;
+    }
+    if (applied != NULL) {
+        *applied = sys->batches[slot].num_app;
+    }
+    remove_stock(sys, slot);
+    if (sys->batches[slot].num_app == 0) { /* unused - full removal */
+        /* unlink from the tree while the key is still there */
+        sys->batch_root = remove_batch_node(sys, sys->batch_root, slot);
+        free_batch_slot(sys, slot);
+        sys->num_batch--;
+    } else { /* its records keep it listed, without doses */
+        sys->batches[slot].doses = 0;
+    }
+    return ERRNONE;
+}
+
+
+/** Deletes vaccination records of a user
+ * @param sys   system structure
+ * @param user_name   name of the user
+ * @param date   only records of this date (NULL for any)
+ * @param batch_name   only records from this batch (NULL for any)
+ * @param deleted   receives the number of records deleted (NULL to ignore)
+ * @details Walks only that user's records, leaving deleted slots in place
+until compact_inoculas() finds enough of them
+ * @return  ERRNONE, ERRNOSUSER, ERRINVDATE (a future date) or ERRNOSBATCH
+ */
+int delete_records(Sys *sys, const char *user_name, const Date *date,
+    const char *batch_name, int *deleted) {
+    int user, batch_id = NIL, prev = NIL, total = 0;
+
+    if (!is_user_found(sys, user_name)) {
+        return ERRNOSUSER;
+    }
+    if (date != NULL && is_future_date(date, sys)) {
+        return ERRINVDATE;
+    }
+    if (batch_name != NULL) {
+        if (!is_batch_found(sys, batch_name)) {
+            return ERRNOSBATCH;
+        }
+        batch_id = find_name(&sys->names, batch_name);
+    }
+    user = find_user(sys, user_name);
+
+    /* filter the user's records, deleting them in place */
+    for (int i = sys->users[user].head; i != NIL; ) {
+        int next = INOCULA(sys, i, next);
+        if (delete_inocula(sys, i, user, date, batch_id)) {
+            Inocula key; /* the columns of the dose set key */
+            key.user_id = user;
+            key.vacc_id = INOCULA(sys, i, vacc_id);
+            key.ap_date = INOCULA(sys, i, ap_date);
+            /* unlink and mark as deleted */
+            unlink_user_record(sys, user, prev, i);
+            remove_dose_key(sys, &key);
+            free_inocula(sys, i);
+            total++;
+            sys->num_dead++;
+        } else {
+            prev = i; /* record stays */
+        }
+        i = next;
+    }
+    compact_inoculas(sys);
+    if (deleted != NULL) {
+        *deleted = total;
+    }
+    return ERRNONE;
+}
+
+
+/** Listing state used while walking the batch tree */
+typedef struct {
+    int vacc_id;        /**< ID of name of vaccine listed (NIL for all) */
+    int found;      /**< batches reported so far */
+    int (*visit)(const BatchInfo *, void *);        /**< caller's callback */
+    void *ctx;      /**< argument of visit */
+} BatchListing;
+
+
+/** Reports a batch of the listing to the caller
+ * @param sys   system structure
+ * @param batch   batch structure
+ * @param ctx   BatchListing
+ * @return  the caller's answer: 0 to go on, anything else to stop
+ */
+static int report_batch(Sys *sys, Batch *batch, void *ctx) {
+    BatchListing *listing = ctx;
+    BatchInfo info;
+
+    if (listing->vacc_id != NIL && batch->vacc_id != listing->vacc_id) {
+        return 0;
+    }
+    info.batch_name = name_of(&sys->names, batch->batch_id);
+    info.vacc_name = name_of(&sys->names, batch->vacc_id);
+    info.exp_date = batch->exp_date;
+    info.doses = batch->doses;
+    info.num_app = batch->num_app;
+    listing->found++;
+    return listing->visit(&info, listing->ctx);
+}
+
+
+/** Lists batches by expiration date, then name
+ * @param sys   system structure
+ * @param vacc_name   only batches of this vaccine, exact case (NULL for all)
+ * @param visit   called with each batch, returns nonzero to stop
+ * @param ctx   argument of visit
+ * @return  ERRNONE, or ERRNOSVACC if a vaccine was given and has no batches
+ */
+int list_batches(Sys *sys, const char *vacc_name,
+    int (*visit)(const BatchInfo *, void *), void *ctx) {
+    BatchListing listing;
+
+    listing.vacc_id = NIL;
+    listing.found = 0;
+    listing.visit = visit;
+    listing.ctx = ctx;
+    if (vacc_name != NULL) {
+        /* a name never interned has no batches */
+        listing.vacc_id = find_name(&sys->names, vacc_name);
+        if (listing.vacc_id == NIL) {
+            return ERRNOSVACC;
+        }
+    }
+    visit_batches(sys, sys->batch_root, report_batch, &listing);
+    return vacc_name != NULL && listing.found == 0 ? ERRNOSVACC : ERRNONE;
+}
+
+
+/** Reports the stock of vaccines, from running totals
+ * @param sys   system structure
+ * @param vacc_name   only this vaccine, any case (NULL for all)
+ * @param visit   called with each vaccine, returns nonzero to stop
+ * @param ctx   argument of visit
+ * @details O(1) per vaccine, whatever its number of batches; all of them
+come in the order the stock index holds them
+ * @return  ERRNONE, or ERRNOSVACC if a vaccine was given and never had
+batches
+ */
+int list_stock(Sys *sys, const char *vacc_name,
+    int (*visit)(const StockInfo *, void *), void *ctx) {
+    StockInfo stock;
+
+    if (vacc_name != NULL) {
+        int vacc = find_vaccine(sys, vacc_name);
+        if (vacc == NIL) {
+            return ERRNOSVACC;
+        }
+        read_stock(sys, vacc, &stock);
+        visit(&stock, ctx);
+        return ERRNONE;
+    }
+    for (int vacc = 0; vacc < sys->num_vacc; vacc++) {
+        read_stock(sys, vacc, &stock);
+        if (visit(&stock, ctx)) {
+            break;
+        }
+    }
+    return ERRNONE;
+}
+
+
+/** Reports a record to the caller
+ * @param sys   system structure
+ * @param pos   index of the record
+ * @param visit   caller's callback
+ * @param ctx   argument of visit
+ * @return  the caller's answer: 0 to go on, anything else to stop
+ */
+static int report_record(Sys *sys, int pos,
+    int (*visit)(const RecordInfo *, void *), void *ctx) {
+    RecordInfo info;
+
+    info.user_name = name_of(&sys->names, INOCULA(sys, pos, user_id));
+    info.vacc_name = name_of(&sys->names, INOCULA(sys, pos, vacc_id));
+    info.batch_name = name_of(&sys->names, INOCULA(sys, pos, batch_id));
+    info.ap_date = INOCULA(sys, pos, ap_date);
+    return visit(&info, ctx);
+}
+
+
+/** Reports the records of a range selected by a filter, in index order
+ * @param sys   system structure
+ * @param filter   predicates of the records reported
+ * @param from   index of the first record of the range
+ * @param to   index past the last record of the range
+ * @param vacc   only records of this vaccine index (NIL for any)
+ * @param visit   called with each record, returns nonzero to stop
+ * @param ctx   argument of visit
+ * @details Each chunk is filtered into a bitmap first, then only the set
+bits are visited. A record keeps the vaccine name as its dose was given, in
+any case, so the vaccine is matched by looking that name up; records mostly
+repeat one spelling, so the last one looked up is remembered
+ * @return  1 if visit stopped the listing, 0 otherwise
+ */
+static int report_selected(Sys *sys, const RecordFilter *filter, int from,
+    int to, int vacc, int (*visit)(const RecordInfo *, void *), void *ctx) {
+    unsigned long long bits[CHUNKWORDS];
+    int last_id = NIL, last_match = 0;
+
+    for (int c = from >> CHUNKBITS; c * CHUNKSIZE < to; c++) {
+        int count = to - c * CHUNKSIZE, skip = from - c * CHUNKSIZE;
+        filter_chunk(sys->chunks[c], count < CHUNKSIZE ? count : CHUNKSIZE,
+            filter, bits);
+        if (skip > 0) { /* drop the records before the range */
+            memset(bits, 0, sizeof(unsigned long long) * (skip >> 6));
+            if (skip & 63) {
+                bits[skip >> 6] &= ~0ULL << (skip & 63);
+            }
+        }
+        for (int w = 0; w < CHUNKWORDS; w++) {
+            for (unsigned long long word = bits[w]; word != 0;
+                word &= word - 1) {
+                int pos = c * CHUNKSIZE + w * 64 + __builtin_ctzll(word);
+                if (vacc != NIL && INOCULA(sys, pos, vacc_id) != last_id) {
+                    last_id = INOCULA(sys, pos, vacc_id);
+                    last_match = find_vaccine(sys,
+                        name_of(&sys->names, last_id)) == vacc;
+                }
+                if (vacc != NIL && !last_match) {
+                    continue;
+                }
+                if (report_record(sys, pos, visit, ctx)) {
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+
+/** Lists vaccination records by application date
+ * @param sys   system structure
+ * @param user_name   only records of this user (NULL for all)
+ * @param visit   called with each record, returns nonzero to stop
+ * @param ctx   argument of visit
+ * @return  ERRNONE, or ERRNOSUSER if a user was given and has no records
+ */
+int list_records(Sys *sys, const char *user_name,
+    int (*visit)(const RecordInfo *, void *), void *ctx) {
+    int user;
+
+    if (user_name == NULL) {
+        RecordFilter live = {NIL, NIL, 0, NIL}; /* skip deleted */
+        report_selected(sys, &live, 0, sys->num_inocula, NIL, visit,
+            ctx);
+        return ERRNONE;
+    }
+    /* walk the user's own records, already in date order */
+    user = find_user(sys, user_name);
+    if (user == NIL || sys->users[user].count == 0) {
+        return ERRNOSUSER;
+    }
+    for (int i = sys->users[user].head; i != NIL; i = INOCULA(sys, i, next)) {
+        if (report_record(sys, i, visit, ctx)) {
+            break;
+        }
+    }
+    return ERRNONE;
+}
+
+
+/** Lists the vaccination records of a date window
+ * @param sys   system structure
+ * @param from   first date of the window
+ * @param to   last date of the window
+ * @param vacc_name   only records of this vaccine, any case (NULL for all)
+ * @param visit   called with each record, returns nonzero to stop
+ * @param ctx   argument of visit
+ * @details Records are stored in date order, so the window is found by two
+binary searches; only its chunks are filtered. The name must be of a
+registered vaccine, as for 'a' and 'v', not just any name interned
+ * @return  ERRNONE, ERRINVDATE if the window ends before it starts, or
+ERRNOSVACC if a vaccine was given and is not registered
+ */
+int list_window(Sys *sys, const Date *from, const Date *to,
+    const char *vacc_name, int (*visit)(const RecordInfo *, void *),
+    void *ctx) {
+    RecordFilter filter = {NIL, NIL, 0, NIL}; /* skip deleted */
+    int vacc = NIL;
+
+    if (*from > *to) {
+        return ERRINVDATE;
+    }
+    if (vacc_name != NULL && (vacc = find_vaccine(sys, vacc_name)) == NIL) {
+        return ERRNOSVACC;
+    }
+    report_selected(sys, &filter,
+        *from == 0 ? 0 : date_position(sys, *from - 1),
+        date_position(sys, *to), vacc, visit, ctx);
+    return ERRNONE;
+}
+
+
+/** Lists the vaccination records of doses from a batch, by date
+ * @param sys   system structure
+ * @param batch_name   name of the batch
+ * @param visit   called with each record, returns nonzero to stop
+ * @param ctx   argument of visit
+ * @details Walks only the batch's own records; deleted ones not yet
+compacted are skipped
+ * @return  ERRNONE or ERRNOSBATCH
+ */
+int list_batch_records(Sys *sys, const char *batch_name,
+    int (*visit)(const RecordInfo *, void *), void *ctx) {
+    int slot = find_batch(sys, batch_name);
+
+    if (slot == NIL) {
+        return ERRNOSBATCH;
+    }
+    for (int i = sys->batches[slot].rec_head; i != NIL;
+        i = INOCULA(sys, i, batch_next)) {
+        if (INOCULA(sys, i, user_id) != NIL &&
+            report_record(sys, i, visit, ctx)) {
+            break;
+        }
+    }
+    return ERRNONE;
+}
+
+
+/** Moves the system date forward
+ * @param sys   system structure
+ * @param date   new date
+ * @details Batches expired by the move leave the stock; expiry_summary()
+tells how many
+ * @return  ERRNONE, or ERRINVDATE if it is not a valid date from today on
+ */
+int advance_date(Sys *sys, const Date *date) {
+    Date from = sys->today;
+
+    if (validate_date(date, sys)) {
+        return ERRINVDATE;
+    }
+    sys->today = *date;
+    retire_expired(sys, from);
+    return ERRNONE;
+}
+
+
+/** Reports the batches retired as expired by moving the date
+ * @param sys   system structure
+ * @param last   receives those of the last move (NULL to ignore)
+ * @param total   receives those of every move since the system started
+(NULL to ignore)
+ */
+void expiry_summary(Sys *sys, Expiry *last, Expiry *total) {
+    if (last != NULL) {
+        *last = sys->last_expiry;
+    }
+    if (total != NULL) {
+        *total = sys->total_expiry;
+    }
+}
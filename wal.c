@@ -0,0 +1,278 @@
+/**
+ * Vaccination Management System - Journal
+ * @brief: This file contains the write-ahead journal of commands:
+ * - Appending the lines of mutating commands as checksummed records
+ * - Group commit: one fdatasync() per JOURNALGROUP records or
+ * JOURNALWINDOW milliseconds, and always before answers are shown
+ * - Reading the records back at startup, dropping a torn tail
+ * @file: wal.c
+ * @author: ist1114455 (Marta Santos)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "project.h"
+
+/** header of a journal record, followed by the command line */
+typedef struct {
+    unsigned int length;        /**< bytes of the command line */
+    unsigned int checksum;      /**< journal_checksum() of lsn and line */
+    long long lsn;      /**< number of the record, counting from 1 */
+} JournalRecord;
+
+
+/** Checksums a record (FNV-1a)
+ * @param lsn   number of the record
+ * @param line   command line
+ * @param len   bytes of the line
+ * @return  checksum
+ */
+static unsigned int journal_checksum(long long lsn, const char *line,
+    size_t len) {
+    unsigned int hash = 2166136261u;
+
+    for (size_t i = 0; i < sizeof(lsn); i++) {
+        hash = (hash ^ ((unsigned char *)&lsn)[i]) * 16777619u;
+    }
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)line[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+/** Current time, in milliseconds
+ * @return  milliseconds on a monotonic clock
+ */
+static long long now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/** Writes bytes to the journal file
+ * @param fd   journal file
+ * @param data   bytes to write
+ * @param len   number of bytes
+ * @return  0 if written, 1 on error
+ */
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+/** Reads bytes from the journal file
+ * @param fd   journal file
+ * @param data   receives the bytes
+ * @param len   number of bytes
+ * @return  0 if all were read, 1 otherwise
+ */
+static int read_all(int fd, char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+/** Opens a journal, creating it if needed
+ * @param journal   journal structure
+ * @param path   path of the journal
+ * @param idiom   language identifier, for the out-of-memory message
+ * @details Leaves the file positioned at the first record, ready for
+replay_journal()
+ * @return  0 if opened, 1 if the file cannot be opened, 2 if it is not a
+journal
+ */
+int open_journal(Journal *journal, const char *path, int idiom) {
+    char magic[sizeof(JOURNALMAGIC)];
+    ssize_t n;
+
+    journal->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (journal->fd < 0) {
+        return 1;
+    }
+    n = read(journal->fd, magic, sizeof(magic));
+    if (n == 0) { /* new journal */
+        if (write_all(journal->fd, JOURNALMAGIC, sizeof(magic))) {
+            close(journal->fd);
+            return 1;
+        }
+    } else if (n != sizeof(magic) ||
+        memcmp(magic, JOURNALMAGIC, sizeof(magic)) != 0) {
+        close(journal->fd);
+        return 2;
+    }
+    journal->cap = JOURNALBLOCK;
+    journal->buf = malloc(journal->cap);
+    check_allocation(journal->buf, idiom);
+    journal->len = 0;
+    journal->pending = 0;
+    journal->first_ms = 0;
+    journal->group = JOURNALGROUP;
+    journal->window = JOURNALWINDOW;
+    journal->end = sizeof(magic);
+    journal->size = lseek(journal->fd, 0, SEEK_END);
+    lseek(journal->fd, journal->end, SEEK_SET);
+    journal->idiom = idiom;
+    return 0;
+}
+
+
+/** Returns the next record of the journal
+ * @param journal   journal structure, as left by open_journal()
+ * @param lsn   receives the number of the record
+ * @details A record cut short or with a bad checksum is the tail of a
+write interrupted by a crash: it and anything after it are cut from the
+file, and the replay ends there
+ * @return  the command line, valid until the next call; NULL at the end
+ */
+char *replay_journal(Journal *journal, long long *lsn) {
+    JournalRecord head;
+
+    if (read_all(journal->fd, (char *)&head, sizeof(head)) == 0 &&
+        journal->end + (long long)sizeof(head) + head.length <=
+        journal->size) {
+        if (head.length + 1 > journal->cap) {
+            journal->cap = head.length + 1;
+            journal->buf = realloc(journal->buf, journal->cap);
+            check_allocation(journal->buf, journal->idiom);
+        }
+        if (read_all(journal->fd, journal->buf, head.length) == 0 &&
+            journal_checksum(head.lsn, journal->buf, head.length) ==
+            head.checksum) {
+            journal->buf[head.length] = '\0';
+            journal->end += sizeof(head) + head.length;
+            *lsn = head.lsn;
+            return journal->buf;
+        }
+    }
+    /* end of the valid records: append after them from now on */
+    if (ftruncate(journal->fd, journal->end) != 0) {
+        journal->end = lseek(journal->fd, 0, SEEK_END);
+    }
+    lseek(journal->fd, journal->end, SEEK_SET);
+    return NULL;
+}
+
+
+/** Makes every appended record durable
+ * @param journal   journal structure
+ * @details Writes the buffered records and waits for them to reach the
+disk, once for the whole group. Commands whose records cannot be made
+durable must not be acknowledged, so failing ends the program
+ */
+void commit_journal(Journal *journal) {
+    int error;
+
+    if (journal->pending == 0) {
+        return;
+    }
+    error = write_all(journal->fd, journal->buf, journal->len) ||
+        fdatasync(journal->fd) != 0;
+    journal->end += journal->len;
+    journal->len = 0;
+    journal->pending = 0;
+    if (error) {
+        write_line(journal->idiom == 0 ? ENOJOURNAL : ENOJOURNALPT);
+        flush_output();
+        exit(EXITJOURNAL);
+    }
+}
+
+
+/** Appends a command line to the journal
+ * @param journal   journal structure
+ * @param lsn   number of the record
+ * @param line   command line, before it is split by the parser
+ * @param len   bytes of the line
+ * @details The record is committed with its group: when JOURNALGROUP
+records are pending, when the oldest one is JOURNALWINDOW ms old, or when
+output is about to be shown (see flush_journal())
+ */
+void log_command(Journal *journal, long long lsn, const char *line,
+    size_t len) {
+    JournalRecord head;
+
+    head.length = len;
+    head.checksum = journal_checksum(lsn, line, len);
+    head.lsn = lsn;
+    if (journal->len + sizeof(head) + len > journal->cap) {
+        while (journal->len + sizeof(head) + len > journal->cap) {
+            journal->cap *= 2;
+        }
+        journal->buf = realloc(journal->buf, journal->cap);
+        check_allocation(journal->buf, journal->idiom);
+    }
+    memcpy(journal->buf + journal->len, &head, sizeof(head));
+    memcpy(journal->buf + journal->len + sizeof(head), line, len);
+    journal->len += sizeof(head) + len;
+
+    if (journal->pending++ == 0) {
+        journal->first_ms = now_ms();
+    }
+    if (journal->pending >= journal->group ||
+        now_ms() - journal->first_ms >= journal->window) {
+        commit_journal(journal);
+    }
+}
+
+
+/** Commits the journal before output is shown
+ * @param ctx   the journal
+ * @details Registered with set_flush_hook(), so no answer reaches stdout
+before the command that produced it is durable
+ */
+void flush_journal(void *ctx) {
+    commit_journal(ctx);
+}
+
+
+/** Empties the journal after a snapshot made it redundant
+ * @param journal   journal structure
+ * @return  0 if emptied, 1 on error
+ */
+int reset_journal(Journal *journal) {
+    commit_journal(journal);
+    journal->end = sizeof(JOURNALMAGIC);
+    return ftruncate(journal->fd, journal->end) != 0 ||
+        lseek(journal->fd, journal->end, SEEK_SET) < 0 ||
+        fdatasync(journal->fd) != 0;
+}
+
+
+/** Commits and closes the journal
+ * @param journal   journal structure
+ */
+void close_journal(Journal *journal) {
+    commit_journal(journal);
+    close(journal->fd);
+    free(journal->buf);
+    journal->buf = NULL;
+}